@@ -1,18 +1,23 @@
 /**
  * Expected Count per Bucket Benchmark for Consistent Hashing
  * Measures E[count in bucket where query lands] ≈ 2N/w (size-biased sampling)
- * Test:  ./build/release/bin/release/expected_count_benchmark --trials 30 --items 1000000 --queries 100000 --width 1000
+ * With V virtual nodes per bucket the arcs of a bucket add up, and the ratio approaches (1 + 1/V) N/w
+ * Test:  ./build/release/bin/release/expected_count_benchmark --trials 30 --items 1000000 --queries 100000 --width 1000 --vnodes 1,4,16
  */
 
 #include "frequency_summary/resketchv2.hpp"
 
 #include "json/json.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iomanip>
+#include <fstream>
 #include <iostream>
 #include <numeric>
 #include <random>
+#include <sstream>
+#include <string>
 #include <vector>
 
 using json = nlohmann::json;
@@ -22,7 +27,7 @@ class ConsistentHashingRing
 public:
     using Ring = std::vector<std::pair<uint64_t, uint32_t>>;
 
-    ConsistentHashingRing(uint32_t width, uint64_t seed = 0) : m_width(width)
+    ConsistentHashingRing(uint32_t width, uint32_t virtual_nodes = 1, uint64_t seed = 0) : m_width(width)
     {
         std::mt19937_64 rng(seed == 0 ? std::random_device{}() : seed);
         std::uniform_int_distribution<uint64_t> dist;
@@ -35,9 +40,12 @@ public:
         m_a = (param_rng() | 1);
         m_b = param_rng();
 
-        // Initialize ring with random hash points
-        m_ring.reserve(width);
-        for (uint32_t j = 0; j < width; ++j) { m_ring.push_back({dist(rng), j}); }
+        // Initialize ring with random hash points, virtual_nodes per bucket
+        m_ring.reserve(width * virtual_nodes);
+        for (uint32_t j = 0; j < width; ++j)
+        {
+            for (uint32_t v = 0; v < virtual_nodes; ++v) { m_ring.push_back({dist(rng), j}); }
+        }
         std::sort(m_ring.begin(), m_ring.end());
     }
 
@@ -76,9 +84,16 @@ struct BucketCountResult
     double ratio_to_n_over_w;
 };
 
-BucketCountResult measure_expected_bucket_count(uint32_t width, uint64_t num_items, uint64_t num_queries)
+struct SketchResult
+{
+    double update_mops;
+    double query_mops;
+    double are;   // over items with a true count of at least N/w
+};
+
+BucketCountResult measure_expected_bucket_count(uint32_t width, uint32_t virtual_nodes, uint64_t num_items, uint64_t num_queries)
 {
-    ConsistentHashingRing ring(width);
+    ConsistentHashingRing ring(width, virtual_nodes);
     std::vector<uint64_t> bucket_counts(width, 0);
     std::mt19937_64 rng(std::random_device{}());
     std::uniform_int_distribution<uint64_t> dist;
@@ -101,6 +116,50 @@ BucketCountResult measure_expected_bucket_count(uint32_t width, uint64_t num_ite
     return {avg_count, avg_count / n_over_w};
 }
 
+// The cost side of virtual nodes: a ReSketchV2 with the same width on a skewed stream (log-uniform item ids), timed end to end
+SketchResult measure_sketch(uint32_t width, uint32_t virtual_nodes, uint64_t num_items)
+{
+    ReSketchConfig config{width, 4, 10};
+    config.virtual_nodes = virtual_nodes;
+    ReSketchV2 sketch(config);
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::vector<uint64_t> items(num_items);
+    for (auto &item : items) item = static_cast<uint64_t>(std::pow(static_cast<double>(num_items), dist(rng))) - 1;
+    std::vector<uint64_t> true_counts(num_items, 0);
+    for (uint64_t item : items) true_counts[item]++;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t item : items) sketch.update(item);
+    double update_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double heavy_threshold = static_cast<double>(num_items) / width;
+    double total_error = 0.0;
+    uint64_t num_heavy = 0, num_queried = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t item = 0; item < num_items; ++item)
+    {
+        if (true_counts[item] == 0) continue;
+        double estimate = sketch.estimate(item);
+        ++num_queried;
+        if (true_counts[item] < heavy_threshold) continue;
+        total_error += std::abs(estimate - static_cast<double>(true_counts[item])) / true_counts[item];
+        ++num_heavy;
+    }
+    double query_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return {num_items / update_seconds / 1e6, num_queried / query_seconds / 1e6, num_heavy ? total_error / num_heavy : 0.0};
+}
+
+std::vector<uint32_t> parse_list(const std::string &list)
+{
+    std::vector<uint32_t> values;
+    std::stringstream ss(list);
+    for (std::string value; std::getline(ss, value, ',');) values.push_back(std::stoul(value));
+    return values;
+}
+
 int main(int argc, char *argv[])
 {
     std::cout << "Expected Count per Bucket Benchmark\n" << std::string(80, '=') << std::endl;
@@ -109,6 +168,7 @@ int main(int argc, char *argv[])
     uint64_t num_items = 100000;
     uint64_t num_queries = 100000;
     uint32_t num_trials = 100;
+    std::vector<uint32_t> virtual_nodes_list = {1};
 
     for (int i = 1; i < argc; ++i)
     {
@@ -117,6 +177,7 @@ int main(int argc, char *argv[])
         else if (arg == "--items" && i + 1 < argc) { num_items = std::stoull(argv[++i]); }
         else if (arg == "--queries" && i + 1 < argc) { num_queries = std::stoull(argv[++i]); }
         else if (arg == "--trials" && i + 1 < argc) { num_trials = std::stoul(argv[++i]); }
+        else if (arg == "--vnodes" && i + 1 < argc) { virtual_nodes_list = parse_list(argv[++i]); }
         else if (arg == "--help")
         {
             std::cout << "Usage: " << argv[0] << " [options]\n"
@@ -124,7 +185,8 @@ int main(int argc, char *argv[])
                       << "  --width N     Number of buckets (default: 100)\n"
                       << "  --items N     Number of items to insert (default: 100000)\n"
                       << "  --queries N   Number of queries (default: 100000)\n"
-                      << "  --trials N    Number of trials (default: 100)\n";
+                      << "  --trials N    Number of trials (default: 100)\n"
+                      << "  --vnodes LIST Comma-separated virtual nodes per bucket to compare (default: 1)\n";
             return 0;
         }
     }
@@ -134,30 +196,45 @@ int main(int argc, char *argv[])
               << n_over_w << "\n"
               << std::endl;
 
-    std::vector<double> ratios;
-    std::vector<double> bucket_counts;
+    json results;
+    results["config"] = {{"width", width}, {"num_items", num_items}, {"num_queries", num_queries}, {"num_trials", num_trials}};
+    results["results"] = json::array();
 
-    for (uint32_t trial = 0; trial < num_trials; ++trial)
+    for (uint32_t virtual_nodes : virtual_nodes_list)
     {
-        auto result = measure_expected_bucket_count(width, num_items, num_queries);
-        ratios.push_back(result.ratio_to_n_over_w);
-        bucket_counts.push_back(result.avg_bucket_count);
-    }
-
-    std::sort(ratios.begin(), ratios.end());
-    double avg_ratio = std::accumulate(ratios.begin(), ratios.end(), 0.0) / num_trials;
-    double avg_bucket_count = std::accumulate(bucket_counts.begin(), bucket_counts.end(), 0.0) / num_trials;
-    double median_ratio = ratios[num_trials / 2];
+        std::vector<double> ratios;
+        std::vector<double> bucket_counts;
 
-    std::cout << "\nRESULTS" << std::endl;
-    std::cout << "Avg. Items in Queried Bucket:   " << std::fixed << std::setprecision(4) << avg_bucket_count << std::endl;
-    std::cout << "Avg. Bias vs. Uniform ratio (N/W):    " << avg_ratio << "x" << std::endl;
-    std::cout << "Median Bias vs. Uniform ratio (N/W):  " << median_ratio << "x" << std::endl;
+        for (uint32_t trial = 0; trial < num_trials; ++trial)
+        {
+            auto result = measure_expected_bucket_count(width, virtual_nodes, num_items, num_queries);
+            ratios.push_back(result.ratio_to_n_over_w);
+            bucket_counts.push_back(result.avg_bucket_count);
+        }
 
-    json results;
-    results["config"] = {{"width", width}, {"num_items", num_items}, {"num_queries", num_queries}, {"num_trials", num_trials}};
-    results["results"] = {{"avg_count", avg_bucket_count}, {"avg_ratio", avg_ratio}, {"median_ratio", median_ratio}};
-    results["all_ratios"] = ratios;
+        std::sort(ratios.begin(), ratios.end());
+        double avg_ratio = std::accumulate(ratios.begin(), ratios.end(), 0.0) / num_trials;
+        double avg_bucket_count = std::accumulate(bucket_counts.begin(), bucket_counts.end(), 0.0) / num_trials;
+        double median_ratio = ratios[num_trials / 2];
+        SketchResult sketch_result = measure_sketch(width, virtual_nodes, num_items);
+
+        std::cout << "\nRESULTS (virtual nodes = " << virtual_nodes << ")" << std::endl;
+        std::cout << "Avg. Items in Queried Bucket:   " << std::fixed << std::setprecision(4) << avg_bucket_count << std::endl;
+        std::cout << "Avg. Bias vs. Uniform ratio (N/W):    " << avg_ratio << "x" << std::endl;
+        std::cout << "Median Bias vs. Uniform ratio (N/W):  " << median_ratio << "x" << std::endl;
+        std::cout << "ReSketchV2 update / query:      " << sketch_result.update_mops << " / " << sketch_result.query_mops << " Mops" << std::endl;
+        std::cout << "ReSketchV2 ARE (count >= N/W):  " << sketch_result.are << std::endl;
+
+        results["results"].push_back(
+            {{"virtual_nodes", virtual_nodes},
+             {"avg_count", avg_bucket_count},
+             {"avg_ratio", avg_ratio},
+             {"median_ratio", median_ratio},
+             {"update_mops", sketch_result.update_mops},
+             {"query_mops", sketch_result.query_mops},
+             {"are", sketch_result.are},
+             {"all_ratios", ratios}});
+    }
 
     std::ofstream out("output/expected_count_results.json");
     if (out)
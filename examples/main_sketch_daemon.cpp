@@ -0,0 +1,55 @@
+#include "frequency_summary/frequency_summary_config.hpp"
+#include "service/service_config.hpp"
+
+#include "service/sketch_server.hpp"
+
+#include "utils/ConfigParser.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Serves named ReSketchV2 instances until SIGINT / SIGTERM; see service/sketch_protocol.hpp for the wire format and
+// service/sketch_client.hpp for a client. The resketch.* options are the defaults of sketches created without a source.
+static SketchServer<> *g_server = nullptr;
+
+static void handle_signal(int) { g_server->stop(); }
+
+int main(int argc, char **argv)
+{
+    ConfigParser parser;
+    SketchServiceConfig service_config;
+    ReSketchConfig rs_config;
+
+    SketchServiceConfig::add_params_to_config_parser(service_config, parser);
+    ReSketchConfig::add_params_to_config_parser(rs_config, parser);
+
+    if (argc > 1 && (string(argv[1]) == "--help" || string(argv[1]) == "-h"))
+    {
+        parser.PrintUsage();
+        return 0;
+    }
+
+    Status s = parser.ParseCommandLine(argc, argv);
+    if (!s.IsOK())
+    {
+        cerr << s.ToString();
+        return -1;
+    }
+
+    SketchServer<> server(service_config, rs_config);
+    g_server = &server;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    if (service_config.port != 0) cout << "Listening on 127.0.0.1:" << service_config.port << endl;
+    else
+    {
+        cout << "Listening on " << service_config.socket_path << endl;
+    }
+    server.run();
+    cout << "Stopped with " << server.get_num_sketches() << " sketches" << endl;
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include "service/service_config.hpp"
+
+#include "service/sketch_client.hpp"
+
+#include "utils/ConfigParser.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Load Test Config
+struct LoadTestConfig
+{
+    string sketch = "load_test";
+    uint32_t width = 1024;
+    uint32_t depth = 4;
+    uint32_t kll_k = 10;
+    uint32_t connections = 1;
+    uint32_t batch_size = 1024;
+    uint32_t pipeline_depth = 16;
+    double duration_s = 5.0;
+    double estimate_fraction = 0.1;
+    uint64_t stream_diversity = 1'000'000;
+
+    static void add_params_to_config_parser(LoadTestConfig &config, ConfigParser &parser)
+    {
+        parser.AddParameter(new StringParameter("app.sketch", config.sketch, &config.sketch, false, "Sketch to load; recreated on start"));
+        parser.AddParameter(new UnsignedInt32Parameter("app.width", to_string(config.width), &config.width, false, "Width of the created sketch"));
+        parser.AddParameter(new UnsignedInt32Parameter("app.depth", to_string(config.depth), &config.depth, false, "Depth of the created sketch"));
+        parser.AddParameter(new UnsignedInt32Parameter("app.kll_k", to_string(config.kll_k), &config.kll_k, false, "K for the KLL sketches of the created sketch"));
+        parser.AddParameter(new UnsignedInt32Parameter("app.connections", to_string(config.connections), &config.connections, false, "Client connections, one thread each"));
+        parser.AddParameter(new UnsignedInt32Parameter("app.batch_size", to_string(config.batch_size), &config.batch_size, false, "Items per request"));
+        parser.AddParameter(
+            new UnsignedInt32Parameter("app.pipeline_depth", to_string(config.pipeline_depth), &config.pipeline_depth, false, "Requests in flight per connection"));
+        parser.AddParameter(new DoubleParameter("app.duration_s", to_string(config.duration_s), &config.duration_s, false, "Seconds to send requests for"));
+        parser.AddParameter(
+            new DoubleParameter("app.estimate_fraction", to_string(config.estimate_fraction), &config.estimate_fraction, false, "Fraction of requests that are estimates"));
+        parser.AddParameter(
+            new UnsignedInt64Parameter("app.stream_diversity", to_string(config.stream_diversity), &config.stream_diversity, false, "Unique items in stream"));
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const LoadTestConfig &config)
+    {
+        os << "\n=== Load Test Configuration ===\n";
+        os << "Sketch: " << config.sketch << " (width " << config.width << ", depth " << config.depth << ", kll_k " << config.kll_k << ")\n";
+        os << "Connections: " << config.connections << "\n";
+        os << "Batch Size: " << config.batch_size << "\n";
+        os << "Pipeline Depth: " << config.pipeline_depth << "\n";
+        os << "Duration: " << config.duration_s << " s\n";
+        os << "Estimate Fraction: " << config.estimate_fraction << "\n";
+        os << "Stream Diversity: " << config.stream_diversity << "\n";
+        return os;
+    }
+};
+
+struct ConnectionResult
+{
+    uint64_t updated_items = 0;
+    uint64_t estimated_items = 0;
+    vector<double> latencies_us;   // per request, from queueing to its response
+};
+
+SketchClient connect(const SketchServiceConfig &service_config)
+{
+    if (service_config.port != 0) return SketchClient::connect_tcp(static_cast<uint16_t>(service_config.port));
+    return SketchClient::connect_unix(service_config.socket_path);
+}
+
+ConnectionResult run_connection(const SketchServiceConfig &service_config, const LoadTestConfig &config, const vector<uint64_t> &pool, uint32_t seed)
+{
+    ConnectionResult result;
+    SketchClient client = connect(service_config);
+    mt19937_64 rng(seed);
+    uniform_int_distribution<size_t> offset_dist(0, pool.size() - config.batch_size);
+    bernoulli_distribution is_estimate(config.estimate_fraction);
+
+    deque<Clock::time_point> sent;
+    auto deadline = Clock::now() + chrono::duration_cast<Clock::duration>(chrono::duration<double>(config.duration_s));
+    while (true)
+    {
+        bool sending = Clock::now() < deadline;
+        while (sending && sent.size() < config.pipeline_depth)
+        {
+            span<const uint64_t> batch(pool.data() + offset_dist(rng), config.batch_size);
+            sent.push_back(Clock::now());
+            if (is_estimate(rng))
+            {
+                client.send_estimate(config.sketch, batch);
+                result.estimated_items += batch.size();
+            }
+            else
+            {
+                client.send_update(config.sketch, batch);
+                result.updated_items += batch.size();
+            }
+        }
+        if (sent.empty()) break;
+
+        SketchClient::Response response = client.receive();
+        if (response.status != sketch_protocol::Status::Ok) { throw runtime_error(response.body); }
+        result.latencies_us.push_back(chrono::duration<double, micro>(Clock::now() - sent.front()).count());
+        sent.pop_front();
+    }
+    return result;
+}
+
+void run_load_test(const SketchServiceConfig &service_config, const LoadTestConfig &config)
+{
+    if (config.batch_size == 0 || config.pipeline_depth == 0 || config.connections == 0) { throw invalid_argument("Batch size, pipeline depth and connections must be positive."); }
+
+    // Items come from a pre-generated pool so the client does not bottleneck on random number generation
+    vector<uint64_t> pool(max<uint64_t>(1u << 20, config.batch_size));
+    mt19937_64 rng(42);
+    uniform_int_distribution<uint64_t> item_dist(1, config.stream_diversity);
+    for (auto &item : pool) item = item_dist(rng);
+
+    {
+        SketchClient admin = connect(service_config);
+        try
+        {
+            admin.drop(config.sketch);
+        }
+        catch (const runtime_error &)
+        {
+            // Not there yet
+        }
+        admin.create(config.sketch, config.width, config.depth, config.kll_k);
+    }
+
+    vector<ConnectionResult> results(config.connections);
+    vector<thread> threads;
+    auto start = Clock::now();
+    for (uint32_t c = 0; c < config.connections; ++c)
+    {
+        threads.emplace_back([&, c]() { results[c] = run_connection(service_config, config, pool, 1000 + c); });
+    }
+    for (auto &t : threads) t.join();
+    double elapsed_s = chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t updated_items = 0, estimated_items = 0;
+    vector<double> latencies_us;
+    for (const auto &result : results)
+    {
+        updated_items += result.updated_items;
+        estimated_items += result.estimated_items;
+        latencies_us.insert(latencies_us.end(), result.latencies_us.begin(), result.latencies_us.end());
+    }
+    sort(latencies_us.begin(), latencies_us.end());
+    auto percentile = [&](double p) { return latencies_us[min<size_t>(latencies_us.size() - 1, static_cast<size_t>(p * latencies_us.size()))]; };
+
+    SketchClient admin = connect(service_config);
+    SketchClient::Info info = admin.info(config.sketch);
+
+    cout << "\n=== Load Test Results ===\n";
+    cout << fixed << setprecision(2);
+    cout << "Elapsed: " << elapsed_s << " s, " << latencies_us.size() << " requests\n";
+    cout << "Updates: " << updated_items << " items, " << updated_items / elapsed_s / 1e6 << " Mops/s\n";
+    cout << "Estimates: " << estimated_items << " items, " << estimated_items / elapsed_s / 1e6 << " Mops/s\n";
+    cout << "Total: " << (updated_items + estimated_items) / elapsed_s / 1e6 << " Mops/s\n";
+    cout << setprecision(1) << "Request latency (us): p50 " << percentile(0.5) << ", p99 " << percentile(0.99) << ", p99.9 " << percentile(0.999) << ", max "
+         << latencies_us.back() << "\n";
+    cout << "Sketch: width " << info.width << ", depth " << info.depth << ", total weight " << info.total_weight << ", " << info.memory_bytes / 1024 << " KiB\n";
+}
+
+int main(int argc, char **argv)
+{
+    ConfigParser parser;
+    SketchServiceConfig service_config;
+    LoadTestConfig load_test_config;
+
+    SketchServiceConfig::add_params_to_config_parser(service_config, parser);
+    LoadTestConfig::add_params_to_config_parser(load_test_config, parser);
+
+    if (argc > 1 && (string(argv[1]) == "--help" || string(argv[1]) == "-h"))
+    {
+        parser.PrintUsage();
+        return 0;
+    }
+
+    Status s = parser.ParseCommandLine(argc, argv);
+    if (!s.IsOK())
+    {
+        cerr << s.ToString();
+        return -1;
+    }
+
+    cout << load_test_config;
+    run_load_test(service_config, load_test_config);
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "utils/BinaryStream.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// HyperLogLog (Flajolet et al.) over 64-bit hashes that the caller has already computed, e.g. the ReSketch partition hash.
+// The top precision bits of a hash select a register, so a register covers one contiguous slice of the hash space; a sketch that only sees
+// part of the space (a split ReSketch) estimates over the registers of its own ranges and ignores the rest.
+// With 64-bit hashes no large-range correction is needed; small cardinalities fall back to linear counting.
+class HyperLogLog
+{
+public:
+    static constexpr uint32_t min_precision = 4;
+    static constexpr uint32_t max_precision = 18;
+
+    // precision 0 disables the sketch (no registers)
+    explicit HyperLogLog(uint32_t precision = 0) : m_precision(precision)
+    {
+        if (precision != 0 && (precision < min_precision || precision > max_precision)) { throw std::invalid_argument("HyperLogLog precision must be in [4, 18]."); }
+        m_registers.assign(precision == 0 ? 0 : (1ULL << precision), 0);
+    }
+
+    void update_hash(uint64_t h)
+    {
+        if (m_precision == 0) return;
+        uint64_t index = h >> (64 - m_precision);
+        // A sentinel bit bounds the rank at 64 - precision + 1
+        uint8_t rank = static_cast<uint8_t>(std::countl_zero((h << m_precision) | (1ULL << (m_precision - 1))) + 1);
+        m_registers[index] = std::max(m_registers[index], rank);
+    }
+
+    // Distinct hashes seen in the whole hash space
+    double estimate() const { return _estimate([](uint64_t) { return true; }); }
+
+    // Distinct hashes seen in the given [start, end) ranges, from the registers overlapping them
+    double estimate(std::span<const std::pair<uint64_t, uint64_t>> ranges) const
+    {
+        return _estimate([&](uint64_t index) { return _overlaps(index, ranges); });
+    }
+
+    // Register-wise max: the sketch of the union
+    void merge(const HyperLogLog &other)
+    {
+        if (m_precision != other.m_precision) { throw std::invalid_argument("HyperLogLogs must have the same precision to merge."); }
+        for (size_t i = 0; i < m_registers.size(); ++i) m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+    }
+
+    static HyperLogLog merge(const HyperLogLog &s1, const HyperLogLog &s2)
+    {
+        HyperLogLog merged = s1;
+        merged.merge(s2);
+        return merged;
+    }
+
+    // Zeroes the registers outside the given ranges, so a later merge with the owner of those ranges does not count them twice
+    void retain_ranges(std::span<const std::pair<uint64_t, uint64_t>> ranges)
+    {
+        for (uint64_t i = 0; i < m_registers.size(); ++i)
+        {
+            if (!_overlaps(i, ranges)) m_registers[i] = 0;
+        }
+    }
+
+    void clear() { std::fill(m_registers.begin(), m_registers.end(), 0); }
+
+    bool is_enabled() const { return m_precision != 0; }
+    uint32_t get_precision() const { return m_precision; }
+
+    uint32_t get_max_memory_usage() const { return m_registers.size() * sizeof(uint8_t); }
+
+    void serialize(std::ostream &os) const
+    {
+        binary_stream::write<uint32_t>(os, m_precision);
+        binary_stream::write_vector(os, m_registers);
+    }
+
+    static HyperLogLog deserialize(std::istream &is)
+    {
+        HyperLogLog hll(binary_stream::read<uint32_t>(is));
+        std::vector<uint8_t> registers = binary_stream::read_vector<uint8_t>(is);
+        if (registers.size() != hll.m_registers.size()) { throw std::runtime_error("HyperLogLog register count does not match its precision."); }
+        hll.m_registers = std::move(registers);
+        return hll;
+    }
+
+private:
+    template <typename IsActive> double _estimate(IsActive &&is_active) const
+    {
+        if (m_precision == 0) { throw std::logic_error("HyperLogLog is disabled (precision 0)."); }
+        double inverse_sum = 0.0;
+        uint64_t active = 0, zeros = 0;
+        for (uint64_t i = 0; i < m_registers.size(); ++i)
+        {
+            if (!is_active(i)) continue;
+            ++active;
+            inverse_sum += std::ldexp(1.0, -m_registers[i]);
+            if (m_registers[i] == 0) ++zeros;
+        }
+        if (active == 0) return 0.0;
+
+        double m = static_cast<double>(active);
+        // The asymptotic alpha only holds from m = 128; smaller register counts (low precision, or few active ranges) use the tabulated values
+        double alpha = m <= 16 ? 0.673 : m <= 32 ? 0.697 : m <= 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+        double raw = alpha * m * m / inverse_sum;
+        if (raw <= 2.5 * m && zeros > 0) return m * std::log(m / static_cast<double>(zeros));
+        return raw;
+    }
+
+    // Register index covers hashes [index << (64 - precision), (index + 1) << (64 - precision))
+    bool _overlaps(uint64_t index, std::span<const std::pair<uint64_t, uint64_t>> ranges) const
+    {
+        uint64_t first = index << (64 - m_precision);
+        uint64_t last = first | (~0ULL >> m_precision);
+        for (const auto &[start, end] : ranges)
+        {
+            if (first < end && last >= start) return true;
+        }
+        return false;
+    }
+
+    uint32_t m_precision;
+    std::vector<uint8_t> m_registers;
+};
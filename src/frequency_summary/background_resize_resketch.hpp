@@ -0,0 +1,193 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Expand/shrink without stopping ingest. start_expand/start_shrink move the sketch into a read-only snapshot (no copy), and a background
+// thread copies the snapshot and remaps the copy. Meanwhile updates are only logged to a delta buffer and counted per item, and queries
+// answer from the snapshot plus the exact delta count. Once the copy is resized, the delta is replayed into it in batches of
+// catch_up_factor * poll_interval per poll (while new updates keep being logged), and when it has caught up it becomes the sketch and the
+// snapshot is freed on a background thread. The ingest thread thus stalls for one replay batch at a time, whose cost scales with the batch.
+// The wrapper itself is single-threaded: update, estimate and the resize calls must come from one thread; only the remap runs elsewhere.
+template <typename Sketch = ReSketchV2> class BackgroundResizeReSketch : public FrequencySummary
+{
+public:
+    // Updates between two checks of whether the background remap has finished
+    static constexpr uint32_t poll_interval = 1024;
+    // Delta entries replayed per poll, relative to the updates logged per poll; must exceed 1 for the replay to catch up
+    static constexpr uint32_t catch_up_factor = 4;
+
+    explicit BackgroundResizeReSketch(const ReSketchConfig &config) : m_sketch(config) {}
+    explicit BackgroundResizeReSketch(Sketch sketch) : m_sketch(std::move(sketch)) {}
+
+    ~BackgroundResizeReSketch()
+    {
+        if (m_pending.valid()) m_pending.wait();
+        if (m_retired.valid()) m_retired.wait();
+    }
+
+    void update(uint64_t item) override
+    {
+        if (!is_resizing()) m_sketch.update(item);
+        else _log(item, 1);
+    }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (!is_resizing()) m_sketch.update(item, weight);
+        else if (weight > 0) _log(item, weight);
+    }
+
+    // While a resize is in flight, the snapshot's estimate plus the exact weight logged for the item since
+    double estimate(uint64_t item) const override
+    {
+        if (!m_snapshot) return m_sketch.estimate(item);
+        auto it = m_delta_counts.find(item);
+        return m_snapshot->estimate(item) + (it == m_delta_counts.end() ? 0.0 : static_cast<double>(it->second));
+    }
+
+    void start_expand(uint32_t new_width)
+    {
+        if (new_width <= m_sketch.get_width()) throw std::invalid_argument("New width must be larger than current width.");
+        _start([new_width](Sketch &sketch) { sketch.expand(new_width); });
+    }
+
+    void start_shrink(uint32_t new_width)
+    {
+        if (new_width >= m_sketch.get_width()) throw std::invalid_argument("New width must be smaller than current width.");
+        _start([new_width](Sketch &sketch) { sketch.shrink(new_width); });
+    }
+
+    // Advances an in-flight resize by at most one replay batch; returns whether a resize is still in flight
+    bool poll()
+    {
+        m_updates_since_poll = 0;
+        if (!is_resizing()) return false;
+        if (!m_resized)
+        {
+            if (m_pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return true;
+            _collect();
+        }
+        _replay(static_cast<size_t>(catch_up_factor) * poll_interval);
+        return is_resizing();
+    }
+
+    // Blocks until the in-flight resize (if any) is installed
+    void finish_resize()
+    {
+        if (!is_resizing()) return;
+        if (!m_resized) _collect();
+        _replay(m_delta.size());
+    }
+
+    bool is_resizing() const { return m_pending.valid() || m_resized != nullptr; }
+    size_t get_delta_size() const { return m_delta.size() - m_replayed; }
+
+    // While a resize is in flight this is the snapshot, which does not hold the updates logged since
+    const Sketch &get_sketch() const { return m_snapshot ? *m_snapshot : m_sketch; }
+
+    // Twice the sketch while a resize is in flight (the snapshot and its resized copy), plus the delta buffer and its per-item counts
+    uint32_t get_max_memory_usage() const
+    {
+        if (!m_snapshot) return m_sketch.get_max_memory_usage();
+        size_t count_node_size = sizeof(std::pair<const uint64_t, uint64_t>) + 2 * sizeof(void *);
+        return 2 * m_snapshot->get_max_memory_usage() + m_delta.capacity() * sizeof(std::pair<uint64_t, uint64_t>) + m_delta_counts.size() * count_node_size;
+    }
+
+private:
+    template <typename Resize> void _start(Resize &&resize)
+    {
+        if (is_resizing()) throw std::logic_error("A resize is already in flight.");
+        m_delta.clear();
+        m_replayed = 0;
+        m_updates_since_poll = 0;
+        m_snapshot = std::make_shared<const Sketch>(std::move(m_sketch));
+        m_pending = std::async(
+            std::launch::async,
+            [snapshot = m_snapshot, resize = std::forward<Resize>(resize)]() mutable
+            {
+                Sketch copy = *snapshot;
+                // The ingest thread keeps the last reference and retires the snapshot off its own thread
+                snapshot.reset();
+                resize(copy);
+                return copy;
+            });
+    }
+
+    void _log(uint64_t item, uint64_t weight)
+    {
+        m_delta.emplace_back(item, weight);
+        m_delta_counts[item] += weight;
+        if (++m_updates_since_poll >= poll_interval) poll();
+    }
+
+    // Takes the result of the background remap; if it failed, rebuilds the sketch from the snapshot and the delta and rethrows
+    void _collect()
+    {
+        try
+        {
+            m_resized = std::make_unique<Sketch>(m_pending.get());
+        }
+        catch (...)
+        {
+            m_sketch = *m_snapshot;
+            m_sketch.update(std::span<const std::pair<uint64_t, uint64_t>>(m_delta));
+            _clear_delta();
+            m_snapshot.reset();
+            throw;
+        }
+    }
+
+    void _clear_delta()
+    {
+        m_delta.clear();
+        m_delta.shrink_to_fit();
+        m_delta_counts = {};
+        m_replayed = 0;
+    }
+
+    // Replays up to max_entries logged updates into the resized sketch; once nothing is left, swaps it in
+    void _replay(size_t max_entries)
+    {
+        size_t count = std::min(max_entries, m_delta.size() - m_replayed);
+        if (count > 0) m_resized->update(std::span<const std::pair<uint64_t, uint64_t>>(m_delta.data() + m_replayed, count));
+        m_replayed += count;
+        if (m_replayed < m_delta.size()) return;
+
+        m_sketch = std::move(*m_resized);
+        m_resized.reset();
+        // Freeing the old buckets (and the per-item counts) is as slow as building them, so that too happens off the ingest thread
+        if (m_retired.valid()) m_retired.wait();
+        // The async state keeps the callable (and its captures) until the future dies on this thread, so free them in the body
+        m_retired = std::async(
+            std::launch::async,
+            [retired = std::move(m_snapshot), counts = std::move(m_delta_counts)]() mutable
+            {
+                retired.reset();
+                counts = {};
+            });
+        _clear_delta();
+    }
+
+    Sketch m_sketch;                                         // moved into m_snapshot while a resize is in flight
+    std::shared_ptr<const Sketch> m_snapshot;                // the sketch as of start_*, answering queries during the resize
+    std::future<Sketch> m_pending;                           // the background remap
+    std::unique_ptr<Sketch> m_resized;                       // its result while the delta is being replayed
+    std::future<void> m_retired;                             // frees the replaced snapshot
+    std::vector<std::pair<uint64_t, uint64_t>> m_delta;      // (item, weight) updates since the snapshot
+    std::unordered_map<uint64_t, uint64_t> m_delta_counts;   // weight per item in m_delta
+    size_t m_replayed = 0;                                   // delta entries already applied to m_resized
+    uint32_t m_updates_since_poll = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+// Exponentially time-decayed counts with a configurable half-life, using forward decay (Cormode et al.).
+// An arrival at time t is stored with weight 2^((t - landmark) / half_life) and a query at time now divides by the same factor for now,
+// so old arrivals fade without touching the sketch and a point query costs the same as ReSketchV2::estimate.
+// Between renormalizations the factor stays in [1, 2^renormalize_bits): the stored weight is rounded randomly (unbiased) and small weights
+// go through the unit update path. Once a factor passes 2^renormalize_bits the landmark moves forward and the sketch is downscaled by
+// 2^renormalize_bits: one pass over the buckets every renormalize_bits half-lives, not per tick.
+template <typename Sketch = ReSketchV2> class DecayedReSketch : public FrequencySummary
+{
+public:
+    static constexpr int renormalize_bits = 1;
+    // Stored weights up to this many go in as repeated unit updates, which are much cheaper than a weighted KLL insertion
+    static constexpr uint64_t max_unit_updates = 4;
+
+    DecayedReSketch(const ReSketchConfig &config, double half_life, double start_time = 0.0)
+        : m_sketch(config), m_half_life(half_life), m_landmark(start_time), m_now(start_time), m_rng(std::random_device{}())
+    {
+        if (!(half_life > 0.0)) { throw std::invalid_argument("Half-life must be positive."); }
+    }
+
+    // Moves the clock forward; time never goes backwards
+    void advance_to(double now)
+    {
+        if (now < m_now) { throw std::invalid_argument("Time must not go backwards."); }
+        m_now = now;
+        // A long gap is handled by a single downscale
+        double exponent = _exponent(m_now);
+        if (exponent >= renormalize_bits) { _renormalize(static_cast<uint32_t>(exponent / renormalize_bits) * renormalize_bits); }
+    }
+
+    // An arrival at the current time
+    void update(uint64_t item) override { update(item, 1); }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        // Randomized rounding keeps the stored integer weight unbiased
+        double scaled = static_cast<double>(weight) * std::exp2(_exponent(m_now));
+        uint64_t stored = static_cast<uint64_t>(scaled);
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(m_rng) < scaled - static_cast<double>(stored)) ++stored;
+        if (stored <= max_unit_updates)
+        {
+            for (uint64_t i = 0; i < stored; ++i) m_sketch.update(item);
+        }
+        else
+        {
+            m_sketch.update(item, stored);
+        }
+    }
+
+    // Decayed count at the current time: sum over arrivals of weight * 2^(-(now - t) / half_life)
+    double estimate(uint64_t item) const override { return m_sketch.estimate(item) * std::exp2(-_exponent(m_now)); }
+
+    double get_time() const { return m_now; }
+    double get_half_life() const { return m_half_life; }
+    const Sketch &get_sketch() const { return m_sketch; }
+
+    uint32_t get_max_memory_usage() const { return m_sketch.get_max_memory_usage(); }
+
+private:
+    // log2 of the scale factor applied to arrivals at time t
+    double _exponent(double t) const { return (t - m_landmark) / m_half_life; }
+
+    void _renormalize(uint32_t shift)
+    {
+        m_sketch.downscale(shift);
+        m_landmark += shift * m_half_life;
+    }
+
+    Sketch m_sketch;
+    double m_half_life;
+    double m_landmark;
+    double m_now;
+    std::mt19937_64 m_rng;
+};
@@ -0,0 +1,383 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+#include "hash/xxhash64.hpp"
+
+#include "utils/BinaryStream.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// A ReSketchV2 that survives restarts: a binary snapshot (ReSketchV2::serialize) plus an append-only write-ahead log of everything since.
+// Updates are applied at once and logged in batches of log_batch_size; expand, shrink, split and merge are logged right after they run,
+// with the ring points they produced (and the merged sketch), so a replay rebuilds the same topology. Log records carry a sequence number
+// and a checksum; a snapshot records the last sequence number it covers, so recovery loads the snapshot and replays only the newer, intact
+// records, dropping a torn tail. A crash loses at most the updates not yet logged plus the records not yet synced (fsync_interval).
+template <typename Sketch = ReSketchV2> class DurableReSketch : public FrequencySummary
+{
+public:
+    enum class RecordType : uint8_t
+    {
+        Updates = 1,
+        Remap = 2,   // expand or shrink
+        Split = 3,
+        Merge = 4
+    };
+
+    static constexpr uint32_t snapshot_magic = 0x4B435352;   // "RSCK"
+    static constexpr uint32_t snapshot_version = 2;
+    static constexpr size_t record_header_size = sizeof(uint32_t) + sizeof(uint64_t);
+
+    // Recovers the state kept in config.directory, or starts a new sketch from sketch_config (and snapshots it) if there is none
+    DurableReSketch(const ReSketchConfig &sketch_config, const DurableReSketchConfig &config)
+        : m_config(config), m_snapshot_path(std::filesystem::path(config.directory) / "snapshot.bin"), m_log_path(std::filesystem::path(config.directory) / "wal.log"),
+          m_sketch(_load_snapshot(sketch_config))
+    {
+        if (config.log_batch_size == 0) { throw std::invalid_argument("Log batch size must be positive."); }
+        uint64_t log_end = m_recovered_from_snapshot ? _replay_log() : 0;
+        m_log_fd = ::open(m_log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_log_fd < 0) { throw std::system_error(errno, std::generic_category(), "open " + m_log_path.string()); }
+        // Drop a torn tail (or a log without snapshot) so new records follow intact ones
+        if (ftruncate(m_log_fd, static_cast<off_t>(log_end)) != 0) { throw std::system_error(errno, std::generic_category(), "ftruncate " + m_log_path.string()); }
+        if (!m_recovered_from_snapshot) checkpoint();
+        m_pending.reserve(config.log_batch_size);
+    }
+
+    DurableReSketch(const DurableReSketch &) = delete;
+    DurableReSketch &operator=(const DurableReSketch &) = delete;
+
+    ~DurableReSketch()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+            // Nothing to report to from a destructor; the updates since the last synced record are lost as after a crash
+        }
+        if (m_log_fd >= 0) ::close(m_log_fd);
+    }
+
+    void update(uint64_t item) override { update(item, 1); }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        m_sketch.update(item, weight);
+        m_pending.emplace_back(item, weight);
+        if (m_pending.size() >= m_config.log_batch_size) _log_pending();
+        _tick(1);
+    }
+
+    void update(std::span<const std::pair<uint64_t, uint64_t>> batch)
+    {
+        m_sketch.update(batch);
+        m_pending.insert(m_pending.end(), batch.begin(), batch.end());
+        if (m_pending.size() >= m_config.log_batch_size) _log_pending();
+        _tick(batch.size());
+    }
+
+    double estimate(uint64_t item) const override { return m_sketch.estimate(item); }
+
+    void expand(uint32_t new_width)
+    {
+        m_sketch.expand(new_width);
+        _log_remap();
+    }
+
+    void shrink(uint32_t new_width)
+    {
+        m_sketch.shrink(new_width);
+        _log_remap();
+    }
+
+    // Keeps the first part (the lower partition ranges) and hands the second one to the caller
+    Sketch split(uint32_t width_kept, uint32_t width_given)
+    {
+        auto [kept, given] = Sketch::split(m_sketch, width_kept, width_given);
+        m_sketch = std::move(kept);
+        std::ostringstream body;
+        binary_stream::write<uint32_t>(body, width_kept);
+        binary_stream::write<uint32_t>(body, width_given);
+        for (const auto &ring : m_sketch.get_rings()) binary_stream::write_vector(body, ring);
+        for (const auto &ring : given.get_rings()) binary_stream::write_vector(body, ring);
+        _log_structural(RecordType::Split, body.str());
+        return std::move(given);
+    }
+
+    // Ring-concatenating merge (Sketch::merge); the other sketch is logged whole
+    void merge(const Sketch &other)
+    {
+        m_sketch = Sketch::merge(m_sketch, other);
+        std::ostringstream body;
+        other.serialize(body);
+        _log_structural(RecordType::Merge, body.str());
+    }
+
+    // Logs the pending updates and syncs the log: everything so far survives a crash
+    void flush()
+    {
+        _log_pending();
+        _sync();
+    }
+
+    // Writes a new snapshot (to a temporary file renamed over the old one) and empties the log
+    void checkpoint()
+    {
+        std::ostringstream payload;
+        m_sketch.serialize(payload);
+        std::string bytes = payload.str();
+
+        std::ostringstream header;
+        binary_stream::write<uint32_t>(header, snapshot_magic);
+        binary_stream::write<uint32_t>(header, snapshot_version);
+        binary_stream::write<uint64_t>(header, m_lsn);
+        binary_stream::write<uint64_t>(header, bytes.size());
+        binary_stream::write<uint64_t>(header, _checksum(bytes));
+
+        std::filesystem::path temporary_path = m_snapshot_path;
+        temporary_path += ".tmp";
+        int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "open " + temporary_path.string()); }
+        _write_all(fd, header.str(), temporary_path);
+        _write_all(fd, bytes, temporary_path);
+        if (fsync(fd) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "fsync " + temporary_path.string());
+        }
+        ::close(fd);
+        std::filesystem::rename(temporary_path, m_snapshot_path);
+        _sync_directory();
+
+        // The snapshot covers every record up to m_lsn and the unlogged updates; a crash before the truncate only leaves records replay skips
+        m_pending.clear();
+        if (ftruncate(m_log_fd, 0) != 0) { throw std::system_error(errno, std::generic_category(), "ftruncate " + m_log_path.string()); }
+        m_records_since_sync = 0;
+        m_updates_since_checkpoint = 0;
+    }
+
+    const Sketch &get_sketch() const { return m_sketch; }
+
+    // Sequence number of the last log record written (or replayed)
+    uint64_t get_lsn() const { return m_lsn; }
+    uint64_t get_num_replayed_records() const { return m_num_replayed_records; }
+
+    uint32_t get_max_memory_usage() const { return m_sketch.get_max_memory_usage() + m_pending.capacity() * sizeof(std::pair<uint64_t, uint64_t>); }
+
+private:
+    static uint64_t _checksum(const std::string &bytes) { return XXHash64::hash(bytes.data(), bytes.size(), 0); }
+
+    Sketch _load_snapshot(const ReSketchConfig &sketch_config)
+    {
+        std::filesystem::create_directories(m_config.directory);
+        std::ifstream in(m_snapshot_path, std::ios::binary);
+        if (!in) return Sketch(sketch_config);
+
+        if (binary_stream::read<uint32_t>(in) != snapshot_magic) { throw std::runtime_error(m_snapshot_path.string() + " is not a ReSketch snapshot."); }
+        if (binary_stream::read<uint32_t>(in) != snapshot_version) { throw std::runtime_error(m_snapshot_path.string() + " has an unsupported version."); }
+        m_lsn = binary_stream::read<uint64_t>(in);
+        uint64_t size = binary_stream::read<uint64_t>(in);
+        uint64_t checksum = binary_stream::read<uint64_t>(in);
+        std::string bytes(size, '\0');
+        if (!in.read(bytes.data(), static_cast<std::streamsize>(size)) || _checksum(bytes) != checksum)
+        {
+            // Snapshots are renamed into place only once complete, so this is damage, not a crash mid-write
+            throw std::runtime_error(m_snapshot_path.string() + " is corrupt.");
+        }
+        m_recovered_from_snapshot = true;
+        std::istringstream payload(bytes);
+        return Sketch::deserialize(payload);
+    }
+
+    // Applies the intact records newer than the snapshot; returns the offset just past the last intact record
+    uint64_t _replay_log()
+    {
+        std::ifstream in(m_log_path, std::ios::binary);
+        if (!in) return 0;
+        uint64_t file_size = std::filesystem::file_size(m_log_path);
+        uint64_t offset = 0;
+        std::string payload;
+        while (offset + record_header_size <= file_size)
+        {
+            uint32_t size = binary_stream::read<uint32_t>(in);
+            uint64_t checksum = binary_stream::read<uint64_t>(in);
+            if (size > file_size - offset - record_header_size) break;
+            payload.resize(size);
+            if (!in.read(payload.data(), size) || _checksum(payload) != checksum) break;
+
+            std::istringstream record(payload);
+            uint64_t lsn = binary_stream::read<uint64_t>(record);
+            auto type = static_cast<RecordType>(binary_stream::read<uint8_t>(record));
+            if (lsn > m_lsn)
+            {
+                _apply(type, record);
+                m_lsn = lsn;
+                ++m_num_replayed_records;
+            }
+            offset += record_header_size + size;
+        }
+        return offset;
+    }
+
+    void _apply(RecordType type, std::istream &record)
+    {
+        switch (type)
+        {
+        case RecordType::Updates:
+        {
+            auto batch = binary_stream::read_vector<std::pair<uint64_t, uint64_t>>(record);
+            m_sketch.update(std::span<const std::pair<uint64_t, uint64_t>>(batch));
+            break;
+        }
+        case RecordType::Remap:
+        {
+            uint32_t new_width = binary_stream::read<uint32_t>(record);
+            m_sketch.remap(new_width, _read_rings(record));
+            break;
+        }
+        case RecordType::Split:
+        {
+            uint32_t width_kept = binary_stream::read<uint32_t>(record);
+            uint32_t width_given = binary_stream::read<uint32_t>(record);
+            auto rings_kept = _read_rings(record);
+            auto rings_given = _read_rings(record);
+            m_sketch = Sketch::split(m_sketch, width_kept, width_given, rings_kept, rings_given).first;
+            break;
+        }
+        case RecordType::Merge:
+        {
+            m_sketch = Sketch::merge(m_sketch, Sketch::deserialize(record));
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown record type in " + m_log_path.string() + ".");
+        }
+    }
+
+    std::vector<typename Sketch::Ring> _read_rings(std::istream &record) const
+    {
+        std::vector<typename Sketch::Ring> rings(m_sketch.get_depth());
+        for (auto &ring : rings) ring = binary_stream::read_vector<std::pair<uint64_t, uint32_t>>(record);
+        return rings;
+    }
+
+    void _tick(uint64_t num_updates)
+    {
+        m_updates_since_checkpoint += num_updates;
+        if (m_config.checkpoint_interval != 0 && m_updates_since_checkpoint >= m_config.checkpoint_interval) checkpoint();
+    }
+
+    void _log_pending()
+    {
+        if (m_pending.empty()) return;
+        _begin_record(RecordType::Updates);
+        binary_stream::append_vector(m_record, m_pending);
+        m_pending.clear();
+        _end_record();
+    }
+
+    void _log_remap()
+    {
+        std::ostringstream body;
+        binary_stream::write<uint32_t>(body, m_sketch.get_width());
+        for (const auto &ring : m_sketch.get_rings()) binary_stream::write_vector(body, ring);
+        _log_structural(RecordType::Remap, body.str());
+    }
+
+    // Updates made before the operation are logged ahead of it; structural records are rare and costly to lose, so they are synced at once
+    void _log_structural(RecordType type, const std::string &body)
+    {
+        _log_pending();
+        _append(type, body);
+        _sync();
+    }
+
+    void _append(RecordType type, const std::string &body)
+    {
+        _begin_record(type);
+        m_record += body;
+        _end_record();
+    }
+
+    // A record is built in place in m_record: size and checksum of the payload, then the payload (sequence number, type, body)
+    void _begin_record(RecordType type)
+    {
+        m_record.assign(record_header_size, '\0');
+        binary_stream::append<uint64_t>(m_record, ++m_lsn);
+        binary_stream::append<uint8_t>(m_record, static_cast<uint8_t>(type));
+    }
+
+    void _end_record()
+    {
+        uint32_t size = static_cast<uint32_t>(m_record.size() - record_header_size);
+        uint64_t checksum = XXHash64::hash(m_record.data() + record_header_size, size, 0);
+        std::memcpy(m_record.data(), &size, sizeof(size));
+        std::memcpy(m_record.data() + sizeof(size), &checksum, sizeof(checksum));
+        _write_all(m_log_fd, m_record, m_log_path);
+
+        if (m_config.fsync_interval != 0 && ++m_records_since_sync >= m_config.fsync_interval) _sync();
+    }
+
+    void _sync()
+    {
+        m_records_since_sync = 0;
+        if (fdatasync(m_log_fd) != 0) { throw std::system_error(errno, std::generic_category(), "fdatasync " + m_log_path.string()); }
+    }
+
+    // Makes the rename of the snapshot durable
+    void _sync_directory() const
+    {
+        int fd = ::open(m_config.directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "open " + m_config.directory); }
+        int result = fsync(fd);
+        int error = errno;
+        ::close(fd);
+        if (result != 0) { throw std::system_error(error, std::generic_category(), "fsync " + m_config.directory); }
+    }
+
+    static void _write_all(int fd, const std::string &bytes, const std::filesystem::path &path)
+    {
+        size_t written = 0;
+        while (written < bytes.size())
+        {
+            ssize_t result = ::write(fd, bytes.data() + written, bytes.size() - written);
+            if (result < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "write " + path.string());
+            }
+            written += static_cast<size_t>(result);
+        }
+    }
+
+    DurableReSketchConfig m_config;
+    std::filesystem::path m_snapshot_path;
+    std::filesystem::path m_log_path;
+    uint64_t m_lsn = 0;                      // last log sequence number; a snapshot stores the one it covers
+    bool m_recovered_from_snapshot = false;
+    Sketch m_sketch;                         // after the fields _load_snapshot sets
+    int m_log_fd = -1;
+    std::vector<std::pair<uint64_t, uint64_t>> m_pending;   // applied but not yet logged
+    std::string m_record;                                   // the log record being built
+    uint32_t m_records_since_sync = 0;
+    uint64_t m_updates_since_checkpoint = 0;
+    uint64_t m_num_replayed_records = 0;
+};
@@ -0,0 +1,319 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary/resketchv2.hpp"
+#include "hash/xxhash64.hpp"
+
+#include "utils/BinaryStream.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Append-only file of epoch sketches (e.g. one per hour) answering "how often did X appear between T1 and T2".
+// Epochs are stored as deltas against a base: the sketch with every bucket emptied (seeds, rings, partition ranges), written once and shared
+// by all following epochs until the rings change. An epoch then only holds its non-empty buckets, each summary as groups of equal-weight
+// items (one group per KLL level) whose sorted hashes are delta and varint encoded, plus the Space-Saving and HyperLogLog side structures.
+// A time-range query reads and merges only the epochs in the range. Not thread-safe: decoded bases are cached inside const queries.
+template <typename Sketch = ReSketchV2> class ReSketchEpochStore
+{
+    using Summary = typename Sketch::SummaryType;
+
+    enum class RecordKind : uint8_t
+    {
+        Base = 1,    // key: base id
+        Epoch = 2    // key: timestamp
+    };
+
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t offset;   // of the payload
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    static constexpr size_t record_header_size = sizeof(uint8_t) + 3 * sizeof(uint64_t);
+
+public:
+    // Opens the store at path, creating it if needed; a torn last record (crash during append) is dropped
+    explicit ReSketchEpochStore(const std::string &path) : m_path(path)
+    {
+        if (!std::filesystem::exists(m_path)) { std::ofstream(m_path, std::ios::binary); }
+        uint64_t file_size = std::filesystem::file_size(m_path);
+        std::ifstream in(m_path, std::ios::binary);
+        uint64_t offset = 0;
+        while (offset + record_header_size <= file_size)
+        {
+            auto kind = static_cast<RecordKind>(binary_stream::read<uint8_t>(in));
+            Entry entry;
+            entry.key = binary_stream::read<uint64_t>(in);
+            entry.size = binary_stream::read<uint64_t>(in);
+            entry.checksum = binary_stream::read<uint64_t>(in);
+            entry.offset = offset + record_header_size;
+            if (entry.size > file_size - entry.offset) break;
+            if (kind == RecordKind::Base) m_bases.push_back(entry);
+            else if (kind == RecordKind::Epoch) m_epochs.push_back(entry);
+            else
+            {
+                break;
+            }
+            offset = entry.offset + entry.size;
+            in.seekg(static_cast<std::streamoff>(offset));
+        }
+        in.close();
+        if (offset != file_size) std::filesystem::resize_file(m_path, offset);
+        if (!m_bases.empty()) m_last_topology = _topology(_base(m_bases.size() - 1));
+    }
+
+    // Stores sketch as the epoch starting at timestamp; timestamps must increase
+    void append(uint64_t timestamp, const Sketch &sketch)
+    {
+        if (!m_epochs.empty() && timestamp <= m_epochs.back().key) { throw std::invalid_argument("Epoch timestamps must be increasing."); }
+
+        // Only a changed topology pays for the emptied copy a base is written from
+        std::string topology = _topology(sketch);
+        if (m_bases.empty() || topology != m_last_topology)
+        {
+            Sketch empty = sketch;
+            empty.reset();
+            std::ostringstream base;
+            empty.serialize(base);
+            _append_record(RecordKind::Base, m_bases.size(), base.str(), m_bases);
+            m_last_topology = std::move(topology);
+        }
+        _append_record(RecordKind::Epoch, timestamp, _encode_epoch(m_bases.size() - 1, sketch), m_epochs);
+    }
+
+    // The epoch stored at exactly timestamp
+    Sketch load(uint64_t timestamp) const
+    {
+        auto it = std::lower_bound(m_epochs.begin(), m_epochs.end(), timestamp, [](const Entry &entry, uint64_t t) { return entry.key < t; });
+        if (it == m_epochs.end() || it->key != timestamp) { throw std::invalid_argument("No epoch stored at this timestamp."); }
+        std::string payload = _read_payload(*it);
+        std::string_view input(payload);
+        Sketch sketch = _base(binary_stream::read_varint(input));
+        _decode_epoch(input, sketch);
+        return sketch;
+    }
+
+    // Merge of the epochs with begin <= timestamp < end. Epochs on the rings of the first one are merged bucket by bucket as they are
+    // decoded; an epoch on other rings is first remapped onto them.
+    Sketch load_range(uint64_t begin, uint64_t end) const
+    {
+        auto first = std::lower_bound(m_epochs.begin(), m_epochs.end(), begin, [](const Entry &entry, uint64_t t) { return entry.key < t; });
+        auto last = std::lower_bound(first, m_epochs.end(), end, [](const Entry &entry, uint64_t t) { return entry.key < t; });
+        if (first == last) { throw std::invalid_argument("No epoch in the requested time range."); }
+
+        std::optional<Sketch> result;
+        uint64_t result_base = 0;
+        for (auto it = first; it != last; ++it)
+        {
+            std::string payload = _read_payload(*it);
+            std::string_view input(payload);
+            uint64_t base_id = binary_stream::read_varint(input);
+            if (!result)
+            {
+                result.emplace(_base(base_id));
+                result_base = base_id;
+                _decode_epoch(input, *result);
+            }
+            else if (base_id == result_base) _decode_epoch(input, *result);
+            else
+            {
+                Sketch part = _base(base_id);
+                _decode_epoch(input, part);
+                part.remap(result->get_width(), result->get_rings());
+                result->merge_in_place(part);
+            }
+        }
+        return std::move(*result);
+    }
+
+    // Estimated occurrences of item in [begin, end)
+    double estimate(uint64_t item, uint64_t begin, uint64_t end) const { return load_range(begin, end).estimate(item); }
+
+    size_t get_num_epochs() const { return m_epochs.size(); }
+    size_t get_num_bases() const { return m_bases.size(); }
+
+    std::vector<uint64_t> get_timestamps() const
+    {
+        std::vector<uint64_t> timestamps;
+        timestamps.reserve(m_epochs.size());
+        for (const auto &entry : m_epochs) timestamps.push_back(entry.key);
+        return timestamps;
+    }
+
+    uint64_t get_file_size() const { return std::filesystem::file_size(m_path); }
+
+private:
+    void _append_record(RecordKind kind, uint64_t key, const std::string &payload, std::vector<Entry> &index)
+    {
+        uint64_t offset = std::filesystem::file_size(m_path);
+        Entry entry{key, offset + record_header_size, payload.size(), XXHash64::hash(payload.data(), payload.size(), 0)};
+        std::ofstream out(m_path, std::ios::binary | std::ios::app);
+        binary_stream::write<uint8_t>(out, static_cast<uint8_t>(kind));
+        binary_stream::write<uint64_t>(out, entry.key);
+        binary_stream::write<uint64_t>(out, entry.size);
+        binary_stream::write<uint64_t>(out, entry.checksum);
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        out.flush();
+        if (!out) { throw std::runtime_error("Failed to append to " + m_path.string() + "."); }
+        index.push_back(entry);
+    }
+
+    std::string _read_payload(const Entry &entry) const
+    {
+        std::ifstream in(m_path, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(entry.offset));
+        std::string payload(entry.size, '\0');
+        if (!in.read(payload.data(), static_cast<std::streamsize>(entry.size)) || XXHash64::hash(payload.data(), payload.size(), 0) != entry.checksum)
+        {
+            throw std::runtime_error(m_path.string() + " has a corrupt record.");
+        }
+        return payload;
+    }
+
+    const Sketch &_base(uint64_t base_id) const
+    {
+        auto it = m_decoded_bases.find(base_id);
+        if (it != m_decoded_bases.end()) return it->second;
+        if (base_id >= m_bases.size()) { throw std::runtime_error(m_path.string() + " refers to a missing base."); }
+        std::istringstream in(_read_payload(m_bases[base_id]));
+        return m_decoded_bases.emplace(base_id, Sketch::deserialize(in)).first->second;
+    }
+
+    // Everything a base holds besides its (empty) buckets: two sketches with equal bytes here share a base
+    static std::string _topology(const Sketch &sketch)
+    {
+        std::ostringstream os;
+        const ReSketchConfig &config = sketch.get_config();
+        binary_stream::write<uint32_t>(os, sketch.get_width());
+        binary_stream::write<uint32_t>(os, sketch.get_depth());
+        binary_stream::write<uint32_t>(os, config.kll_k);
+        binary_stream::write<uint8_t>(os, config.adaptive_k);
+        binary_stream::write<uint32_t>(os, config.top_k_candidates);
+        binary_stream::write<uint8_t>(os, config.invertible_partition_hash);
+        binary_stream::write<uint32_t>(os, config.hll_precision);
+        binary_stream::write<uint8_t>(os, config.load_aware_resize);
+        binary_stream::write<uint32_t>(os, config.virtual_nodes);
+        binary_stream::write<uint32_t>(os, sketch.get_partition_seed());
+        binary_stream::write_vector(os, std::vector<uint32_t>(sketch.get_seeds().begin(), sketch.get_seeds().end()));
+        for (uint32_t i = 0; i < sketch.get_depth(); ++i)
+        {
+            auto [a, b] = sketch.get_row_hash_parameters(i);
+            binary_stream::write<uint64_t>(os, a);
+            binary_stream::write<uint64_t>(os, b);
+        }
+        binary_stream::write_vector(os, sketch.get_partition_ranges());
+        for (const auto &ring : sketch.get_rings()) binary_stream::write_vector(os, ring);
+        return os.str();
+    }
+
+    static std::string _encode_epoch(uint64_t base_id, const Sketch &sketch)
+    {
+        std::string out;
+        binary_stream::append_varint(out, base_id);
+
+        std::ostringstream side;
+        sketch.get_candidates().serialize(side);
+        sketch.get_distinct_sketch().serialize(side);
+        binary_stream::append_varint(out, side.str().size());
+        out += side.str();
+
+        uint64_t num_touched = 0;
+        sketch.for_each_bucket([&](uint32_t, uint32_t, uint64_t count, const Summary &) { num_touched += count != 0; });
+        binary_stream::append_varint(out, num_touched);
+
+        uint64_t previous_index = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> items;   // (weight, hash), so a sort groups items by level
+        sketch.for_each_bucket(
+            [&](uint32_t row, uint32_t bucket_id, uint64_t count, const Summary &summary)
+            {
+                if (count == 0) return;
+                uint64_t index = static_cast<uint64_t>(row) * sketch.get_width() + bucket_id;
+                binary_stream::append_varint(out, index - previous_index);
+                previous_index = index;
+                binary_stream::append_varint(out, count);
+                binary_stream::append_varint(out, summary.get_config().k);
+
+                items.clear();
+                summary.for_each_summarized_item([&](uint64_t h, uint64_t weight) { items.emplace_back(weight, h); });
+                std::sort(items.begin(), items.end());
+                uint64_t num_groups = 0;
+                for (size_t i = 0; i < items.size(); ++i) num_groups += i == 0 || items[i].first != items[i - 1].first;
+                binary_stream::append_varint(out, num_groups);
+                for (size_t begin = 0; begin < items.size();)
+                {
+                    size_t end = begin;
+                    while (end < items.size() && items[end].first == items[begin].first) ++end;
+                    binary_stream::append_varint(out, items[begin].first);
+                    binary_stream::append_varint(out, end - begin);
+                    uint64_t previous_hash = 0;
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        binary_stream::append_varint(out, items[i].second - previous_hash);
+                        previous_hash = items[i].second;
+                    }
+                    begin = end;
+                }
+            });
+        return out;
+    }
+
+    // Merges the epoch encoded in input into sketch, which is on the epoch's rings
+    static void _decode_epoch(std::string_view input, Sketch &sketch)
+    {
+        uint64_t side_size = binary_stream::read_varint(input);
+        if (side_size > input.size()) throw std::runtime_error("Truncated epoch record.");
+        std::istringstream side{std::string(input.substr(0, side_size))};
+        input.remove_prefix(side_size);
+        SpaceSaving candidates = SpaceSaving::deserialize(side);
+        HyperLogLog distinct = HyperLogLog::deserialize(side);
+        sketch.merge_side_structures(candidates, distinct);
+
+        uint64_t num_touched = binary_stream::read_varint(input);
+        uint64_t num_buckets = static_cast<uint64_t>(sketch.get_depth()) * sketch.get_width();
+        uint64_t index = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> weighted_items;
+        for (uint64_t b = 0; b < num_touched; ++b)
+        {
+            index += binary_stream::read_varint(input);
+            if (index >= num_buckets) throw std::runtime_error("Epoch record refers to a bucket beyond its base.");
+            uint64_t count = binary_stream::read_varint(input);
+            KLLConfig config{static_cast<uint32_t>(binary_stream::read_varint(input))};
+
+            weighted_items.clear();
+            uint64_t num_groups = binary_stream::read_varint(input);
+            for (uint64_t g = 0; g < num_groups; ++g)
+            {
+                uint64_t weight = binary_stream::read_varint(input);
+                uint64_t n = binary_stream::read_varint(input);
+                uint64_t hash = 0;
+                for (uint64_t i = 0; i < n; ++i)
+                {
+                    hash += binary_stream::read_varint(input);
+                    weighted_items.emplace_back(hash, weight);
+                }
+            }
+            Summary summary = weighted_items.empty() ? Summary(config) : Summary::construct_from_weighted_items(weighted_items, config);
+            sketch.merge_into_bucket(static_cast<uint32_t>(index / sketch.get_width()), static_cast<uint32_t>(index % sketch.get_width()), count, summary);
+        }
+    }
+
+    std::filesystem::path m_path;
+    std::vector<Entry> m_bases;    // by base id
+    std::vector<Entry> m_epochs;   // by timestamp
+    std::string m_last_topology;   // of the newest base, to detect unchanged rings
+    mutable std::map<uint64_t, Sketch> m_decoded_bases;
+};
@@ -34,13 +34,31 @@ struct ReSketchConfig
     uint32_t width;
     uint32_t depth;
     uint32_t kll_k;
+    bool adaptive_k = false;
+    uint32_t top_k_candidates = 0;
+    bool invertible_partition_hash = false;
+    uint32_t hll_precision = 0;
+    bool load_aware_resize = false;
+    uint32_t virtual_nodes = 1;
     static void add_params_to_config_parser(ReSketchConfig &c, ConfigParser &p)
     {
         p.AddParameter(new UnsignedInt32Parameter("resketch.width", "64", &c.width, false, "Initial width of ReSketch"));
         p.AddParameter(new UnsignedInt32Parameter("resketch.depth", "4", &c.depth, false, "Depth of ReSketch"));
         p.AddParameter(new UnsignedInt32Parameter("resketch.kll_k", "10", &c.kll_k, false, "K for inner KLL sketches"));
+        p.AddParameter(new BooleanParameter("resketch.adaptive_k", "false", &c.adaptive_k, false, "Redistribute the KLL k budget across buckets by their mass"));
+        p.AddParameter(new UnsignedInt32Parameter("resketch.top_k_candidates", "0", &c.top_k_candidates, false, "Space-Saving counters kept for top_k queries (0 disables)"));
+        p.AddParameter(new BooleanParameter("resketch.invertible_partition_hash", "false", &c.invertible_partition_hash, false, "Use an invertible partition hash so heavy_hitters can decode items from the buckets"));
+        p.AddParameter(new UnsignedInt32Parameter("resketch.hll_precision", "0", &c.hll_precision, false, "HyperLogLog precision for estimate_distinct, 2^p registers (0 disables)"));
+        p.AddParameter(new BooleanParameter("resketch.load_aware_resize", "false", &c.load_aware_resize, false, "Expand by splitting the heaviest arcs and shrink by dropping the lightest points"));
+        p.AddParameter(new UnsignedInt32Parameter("resketch.virtual_nodes", "1", &c.virtual_nodes, false, "Ring points per bucket; more points give more even bucket loads"));
+    }
+    auto to_tuple() const
+    {
+        return std::make_tuple(
+            "width", width, "depth", depth, "kll_k", kll_k, "adaptive_k", adaptive_k, "top_k_candidates", top_k_candidates, "invertible_partition_hash",
+            invertible_partition_hash, "hll_precision", hll_precision, "load_aware_resize", load_aware_resize, "virtual_nodes",
+            virtual_nodes);
     }
-    auto to_tuple() const { return std::make_tuple("width", width, "depth", depth, "kll_k", kll_k); }
     friend std::ostream &operator<<(std::ostream &os, const ReSketchConfig &c)
     {
         ConfigPrinter<ReSketchConfig>::print(os, c);
@@ -48,6 +66,84 @@ struct ReSketchConfig
     }
 };
 
+struct ReSketchAutoscalerConfig
+{
+    uint32_t memory_budget;
+    uint32_t min_width = 16;
+    double target_items_per_bucket = 64.0;
+    double max_load_skew = 4.0;
+    double growth_factor = 2.0;
+    double hysteresis = 0.25;
+    uint64_t check_interval = 65536;
+    uint64_t min_items_between_resizes = 1048576;
+    static void add_params_to_config_parser(ReSketchAutoscalerConfig &c, ConfigParser &p)
+    {
+        p.AddParameter(new UnsignedInt32Parameter("autoscaler.memory_budget", "1048576", &c.memory_budget, false, "Memory budget in bytes that expand never exceeds"));
+        p.AddParameter(new UnsignedInt32Parameter("autoscaler.min_width", "16", &c.min_width, false, "Width below which the autoscaler never shrinks"));
+        p.AddParameter(new DoubleParameter("autoscaler.target_items_per_bucket", "64", &c.target_items_per_bucket, false, "Distinct items per bucket the width is sized for (0 disables)"));
+        p.AddParameter(new DoubleParameter("autoscaler.max_load_skew", "4", &c.max_load_skew, false, "Max over mean bucket count, relative to uniform hashing, above which the sketch expands (0 disables)"));
+        p.AddParameter(new DoubleParameter("autoscaler.growth_factor", "2", &c.growth_factor, false, "Largest factor by which one expand or shrink changes the width"));
+        p.AddParameter(new DoubleParameter("autoscaler.hysteresis", "0.25", &c.hysteresis, false, "Relative gap between target and current width needed before resizing"));
+        p.AddParameter(new UnsignedInt64Parameter("autoscaler.check_interval", "65536", &c.check_interval, false, "Updates between two autoscaler checks"));
+        p.AddParameter(new UnsignedInt64Parameter("autoscaler.min_items_between_resizes", "1048576", &c.min_items_between_resizes, false, "Updates that must pass between two structural operations"));
+    }
+    auto to_tuple() const
+    {
+        return std::make_tuple(
+            "memory_budget", memory_budget, "min_width", min_width, "target_items_per_bucket", target_items_per_bucket, "max_load_skew", max_load_skew, "growth_factor",
+            growth_factor, "hysteresis", hysteresis, "check_interval", check_interval, "min_items_between_resizes", min_items_between_resizes);
+    }
+    friend std::ostream &operator<<(std::ostream &os, const ReSketchAutoscalerConfig &c)
+    {
+        ConfigPrinter<ReSketchAutoscalerConfig>::print(os, c);
+        return os;
+    }
+};
+
+struct DurableReSketchConfig
+{
+    std::string directory;
+    uint32_t log_batch_size = 4096;
+    uint32_t fsync_interval = 16;
+    uint64_t checkpoint_interval = 0;
+    static void add_params_to_config_parser(DurableReSketchConfig &c, ConfigParser &p)
+    {
+        p.AddParameter(new StringParameter("durable.directory", "resketch_state", &c.directory, false, "Directory holding the snapshot and the write-ahead log"));
+        p.AddParameter(new UnsignedInt32Parameter("durable.log_batch_size", "4096", &c.log_batch_size, false, "Updates collected into one log record"));
+        p.AddParameter(new UnsignedInt32Parameter("durable.fsync_interval", "16", &c.fsync_interval, false, "Log records between two fsyncs (0 leaves write-back to the OS)"));
+        p.AddParameter(new UnsignedInt64Parameter("durable.checkpoint_interval", "0", &c.checkpoint_interval, false, "Updates between two automatic snapshots (0 disables)"));
+    }
+    auto to_tuple() const
+    {
+        return std::make_tuple(
+            "directory", directory, "log_batch_size", log_batch_size, "fsync_interval", fsync_interval, "checkpoint_interval", checkpoint_interval);
+    }
+    friend std::ostream &operator<<(std::ostream &os, const DurableReSketchConfig &c)
+    {
+        ConfigPrinter<DurableReSketchConfig>::print(os, c);
+        return os;
+    }
+};
+
+struct ReSketchPoolConfig
+{
+    std::string spill_directory;
+    uint32_t max_resident_tenants = 1024;
+    uint32_t slab_size_kb = 1024;
+    static void add_params_to_config_parser(ReSketchPoolConfig &c, ConfigParser &p)
+    {
+        p.AddParameter(new StringParameter("pool.spill_directory", "resketch_pool", &c.spill_directory, false, "Directory holding the tenants spilled out of memory"));
+        p.AddParameter(new UnsignedInt32Parameter("pool.max_resident_tenants", "1024", &c.max_resident_tenants, false, "Tenants kept in memory before the least recently used is spilled (0 keeps all)"));
+        p.AddParameter(new UnsignedInt32Parameter("pool.slab_size_kb", "1024", &c.slab_size_kb, false, "Size of the slabs bucket arrays are carved from"));
+    }
+    auto to_tuple() const { return std::make_tuple("spill_directory", spill_directory, "max_resident_tenants", max_resident_tenants, "slab_size_kb", slab_size_kb); }
+    friend std::ostream &operator<<(std::ostream &os, const ReSketchPoolConfig &c)
+    {
+        ConfigPrinter<ReSketchPoolConfig>::print(os, c);
+        return os;
+    }
+};
+
 struct GeometricSketchConfig
 {
     uint32_t width;
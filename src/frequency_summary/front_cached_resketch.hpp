@@ -0,0 +1,134 @@
+#pragma once
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <utility>
+
+// ReSketch with a small front table that absorbs heavy items before they reach the buckets (the heavy part of Elastic Sketch).
+// Each slot holds one item and its pending count. A different item hashing to an occupied slot casts a negative vote; once the votes reach
+// eviction_ratio times the resident's count, the resident is flushed to the sketch as a single weighted update and the newcomer takes the slot.
+// Otherwise the newcomer goes straight to the sketch. Heavy items therefore cost one table probe per arrival instead of depth bucket updates.
+// Estimates add the pending count to the sketch's estimate; structural operations flush first, so merge and split see every update.
+template <typename Sketch = ReSketchV2, uint32_t Slots = 1024> class FrontCachedReSketch : public FrequencySummary
+{
+    static_assert(Slots >= 2 && (Slots & (Slots - 1)) == 0, "Slots must be a power of two, at least 2.");
+
+    struct Slot
+    {
+        uint64_t item = 0;
+        uint64_t count = 0;   // pending, not yet in the sketch
+        uint64_t negative_votes = 0;
+        bool occupied = false;
+    };
+
+public:
+    static constexpr uint64_t eviction_ratio = 8;
+
+    // flush_interval > 0 also flushes every pending count after that many updates, bounding how long counts stay only in the table
+    explicit FrontCachedReSketch(const ReSketchConfig &config, uint64_t flush_interval = 0) : m_sketch(config), m_flush_interval(flush_interval) {}
+
+    explicit FrontCachedReSketch(Sketch sketch, uint64_t flush_interval = 0) : m_sketch(std::move(sketch)), m_flush_interval(flush_interval) {}
+
+    void update(uint64_t item) override { update(item, 1); }
+
+    // Weighted arrivals vote with their weight
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        Slot &slot = m_table[_slot_index(item)];
+        if (slot.occupied && slot.item == item) { slot.count += weight; }
+        else if (!slot.occupied)
+        {
+            slot = {item, weight, 0, true};
+        }
+        else if ((slot.negative_votes += weight) >= eviction_ratio * std::max<uint64_t>(slot.count, 1))
+        {
+            m_sketch.update(slot.item, slot.count);
+            slot = {item, weight, 0, true};
+        }
+        else
+        {
+            m_sketch.update(item, weight);
+        }
+
+        if (m_flush_interval > 0 && ++m_updates_since_flush >= m_flush_interval) { flush(); }
+    }
+
+    double estimate(uint64_t item) const override
+    {
+        const Slot &slot = m_table[_slot_index(item)];
+        double pending = (slot.occupied && slot.item == item) ? static_cast<double>(slot.count) : 0.0;
+        return m_sketch.estimate(item) + pending;
+    }
+
+    // Pushes every pending count into the sketch; residents keep their slot with a zero count
+    void flush()
+    {
+        for (auto &slot : m_table)
+        {
+            if (slot.occupied && slot.count > 0)
+            {
+                m_sketch.update(slot.item, slot.count);
+                slot.count = 0;
+                slot.negative_votes = 0;
+            }
+        }
+        m_updates_since_flush = 0;
+    }
+
+    // --- Structure-defining Operations ---
+
+    void expand(uint32_t new_width)
+    {
+        flush();
+        m_sketch.expand(new_width);
+    }
+
+    void shrink(uint32_t new_width)
+    {
+        flush();
+        m_sketch.shrink(new_width);
+    }
+
+    static FrontCachedReSketch merge(const FrontCachedReSketch &s1, const FrontCachedReSketch &s2)
+    {
+        return FrontCachedReSketch(Sketch::merge(s1._flushed_sketch(), s2._flushed_sketch()), s1.m_flush_interval);
+    }
+
+    static std::pair<FrontCachedReSketch, FrontCachedReSketch> split(const FrontCachedReSketch &sketch, uint32_t width_1, uint32_t width_2)
+    {
+        auto [s1, s2] = Sketch::split(sketch._flushed_sketch(), width_1, width_2);
+        return {FrontCachedReSketch(std::move(s1), sketch.m_flush_interval), FrontCachedReSketch(std::move(s2), sketch.m_flush_interval)};
+    }
+
+    uint32_t get_max_memory_usage() const { return m_sketch.get_max_memory_usage() + sizeof(m_table); }
+
+    bool is_responsible_for(uint64_t item) const { return m_sketch.is_responsible_for(item); }
+
+    // The underlying sketch; counts still pending in the table are not included until flush()
+    const Sketch &get_sketch() const { return m_sketch; }
+
+private:
+    // Multiplicative hashing: the table must stay cheaper than the sketch's XXHash64
+    static uint32_t _slot_index(uint64_t item) { return static_cast<uint32_t>((item * 0x9E3779B97F4A7C15ULL) >> (64 - std::countr_zero(Slots))); }
+
+    Sketch _flushed_sketch() const
+    {
+        Sketch sketch = m_sketch;
+        for (const auto &slot : m_table)
+        {
+            if (slot.occupied && slot.count > 0) sketch.update(slot.item, slot.count);
+        }
+        return sketch;
+    }
+
+    Sketch m_sketch;
+    std::array<Slot, Slots> m_table{};
+    uint64_t m_flush_interval;
+    uint64_t m_updates_since_flush = 0;
+};
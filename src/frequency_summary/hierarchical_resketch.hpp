@@ -0,0 +1,143 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Multi-resolution counts over IPv4 addresses (as packed by read_caida_data): one sketch per prefix length /8, /16, /24 and /32.
+// A batch is ingested level by level: each level first aggregates the batch by prefix, so coarse levels see at most a few hundred weighted
+// updates per batch, and then inserts them with one batched weighted update (one pass over that level's rings and buckets).
+// hierarchical_heavy_hitters() descends only into prefixes that are heavy themselves.
+template <typename Sketch = ReSketchV2> class HierarchicalReSketch : public FrequencySummary
+{
+public:
+    static constexpr uint32_t num_levels = 4;
+    static constexpr std::array<uint32_t, num_levels> prefix_lengths = {8, 16, 24, 32};
+
+    struct HeavyPrefix
+    {
+        uint32_t prefix_length;
+        uint64_t prefix;            // address >> (32 - prefix_length)
+        double estimate;            // all traffic under the prefix
+        double residual_estimate;   // traffic not already covered by heavy sub-prefixes
+    };
+
+    explicit HierarchicalReSketch(const ReSketchConfig &config) : HierarchicalReSketch(config, {config.width, config.width, config.width, config.width}) {}
+
+    // Coarse levels hold few distinct keys, so they can be given a smaller width
+    HierarchicalReSketch(const ReSketchConfig &config, const std::array<uint32_t, num_levels> &level_widths)
+    {
+        m_levels.reserve(num_levels);
+        for (uint32_t level = 0; level < num_levels; ++level)
+        {
+            ReSketchConfig level_config = config;
+            level_config.width = level_widths[level];
+            m_levels.emplace_back(level_config);
+        }
+    }
+
+    void update(uint64_t address) override
+    {
+        for (uint32_t level = 0; level < num_levels; ++level) { m_levels[level].update(prefix_of(address, level)); }
+    }
+
+    void update(std::span<const uint64_t> addresses)
+    {
+        std::unordered_map<uint64_t, uint64_t> aggregated;
+        std::vector<std::pair<uint64_t, uint64_t>> weighted_prefixes;
+        for (uint32_t level = 0; level < num_levels; ++level)
+        {
+            aggregated.clear();
+            for (uint64_t address : addresses) { ++aggregated[prefix_of(address, level)]; }
+            weighted_prefixes.assign(aggregated.begin(), aggregated.end());
+            m_levels[level].update(std::span<const std::pair<uint64_t, uint64_t>>(weighted_prefixes));
+        }
+    }
+
+    // Count of the full address (/32)
+    double estimate(uint64_t address) const override { return estimate_prefix(address, num_levels - 1); }
+
+    double estimate_prefix(uint64_t address, uint32_t level) const { return m_levels[level].estimate(prefix_of(address, level)); }
+
+    // Heavy prefixes at every level, found top-down: the children of a prefix are only queried when the prefix itself reaches threshold.
+    // A prefix is reported when its residual (its estimate minus the estimates of its closest reported descendants) still reaches threshold,
+    // i.e. the classic hierarchical heavy hitter definition; results are ordered from coarse to fine.
+    std::vector<HeavyPrefix> hierarchical_heavy_hitters(double threshold) const
+    {
+        std::vector<std::vector<HeavyPrefix>> heavy(num_levels);
+        for (uint64_t prefix = 0; prefix < (1ULL << prefix_lengths[0]); ++prefix)
+        {
+            double estimated_count = m_levels[0].estimate(prefix);
+            if (estimated_count >= threshold) heavy[0].push_back({prefix_lengths[0], prefix, estimated_count, estimated_count});
+        }
+        for (uint32_t level = 1; level < num_levels; ++level)
+        {
+            uint32_t child_bits = prefix_lengths[level] - prefix_lengths[level - 1];
+            for (const auto &parent : heavy[level - 1])
+            {
+                for (uint64_t suffix = 0; suffix < (1ULL << child_bits); ++suffix)
+                {
+                    uint64_t prefix = (parent.prefix << child_bits) | suffix;
+                    double estimated_count = m_levels[level].estimate(prefix);
+                    if (estimated_count >= threshold) heavy[level].push_back({prefix_lengths[level], prefix, estimated_count, estimated_count});
+                }
+            }
+        }
+
+        // Discount reported descendants from their ancestors, finest level first: a reported child covers its whole estimate,
+        // an unreported one passes on what its own reported descendants covered
+        std::vector<std::vector<double>> covered(num_levels);
+        for (uint32_t level = 0; level < num_levels; ++level) covered[level].assign(heavy[level].size(), 0.0);
+        for (uint32_t level = num_levels - 1; level > 0; --level)
+        {
+            uint32_t child_bits = prefix_lengths[level] - prefix_lengths[level - 1];
+            for (size_t c = 0; c < heavy[level].size(); ++c)
+            {
+                auto &child = heavy[level][c];
+                child.residual_estimate = child.estimate - covered[level][c];
+                auto parent = std::lower_bound(
+                    heavy[level - 1].begin(), heavy[level - 1].end(), child.prefix >> child_bits,
+                    [](const HeavyPrefix &p, uint64_t prefix)
+                    {
+                        return p.prefix < prefix;
+                    });
+                covered[level - 1][parent - heavy[level - 1].begin()] += child.residual_estimate >= threshold ? child.estimate : covered[level][c];
+            }
+        }
+        for (size_t p = 0; p < heavy[0].size(); ++p) heavy[0][p].residual_estimate = heavy[0][p].estimate - covered[0][p];
+
+        std::vector<HeavyPrefix> result;
+        for (const auto &level_heavy : heavy)
+        {
+            for (const auto &prefix : level_heavy)
+            {
+                if (prefix.residual_estimate >= threshold) result.push_back(prefix);
+            }
+        }
+        return result;
+    }
+
+    static uint64_t prefix_of(uint64_t address, uint32_t level) { return (address & 0xFFFFFFFFULL) >> (32 - prefix_lengths[level]); }
+
+    const Sketch &get_level(uint32_t level) const { return m_levels[level]; }
+    Sketch &get_level(uint32_t level) { return m_levels[level]; }
+
+    uint32_t get_max_memory_usage() const
+    {
+        uint32_t total = 0;
+        for (const auto &level : m_levels) total += level.get_max_memory_usage();
+        return total;
+    }
+
+private:
+    std::vector<Sketch> m_levels;   // one per prefix length, coarse to fine
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary/resketchv2.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+// Drives expand/shrink of an attached sketch online, replacing the precomputed memory schedules of the expansion/shrinking experiments.
+// Every check_interval updates it sizes the width for target_items_per_bucket distinct items per bucket (estimate_distinct(), so the sketch
+// needs hll_precision), expands further when full buckets are too skewed, and never exceeds memory_budget. A skew-driven expand raises a
+// floor the distinct-item target cannot shrink below, so the two signals do not undo each other.
+// Against thrashing: a resize needs the target to leave a hysteresis band around the current width, at least min_items_between_resizes
+// updates since the previous one, and moves the width by at most growth_factor. Only an over-budget sketch is shrunk at once.
+template <typename Sketch = ReSketchV2> class ReSketchAutoscaler
+{
+public:
+    enum class Action
+    {
+        None,
+        Expand,
+        Shrink
+    };
+
+    // The skew signal is ignored until buckets hold this many items on average, where the balls-in-bins baseline is still a poor fit
+    static constexpr double min_mean_count_for_skew = 64.0;
+
+    ReSketchAutoscaler(Sketch &sketch, const ReSketchAutoscalerConfig &config) : m_sketch(sketch), m_config(config)
+    {
+        if (config.growth_factor <= 1.0) { throw std::invalid_argument("Autoscaler growth factor must be larger than 1."); }
+        if (config.hysteresis < 0.0 || config.hysteresis >= 1.0) { throw std::invalid_argument("Autoscaler hysteresis must be in [0, 1)."); }
+        // The ingested count only grows, so sizing by it would never shrink
+        if (config.target_items_per_bucket > 0.0 && sketch.get_config().hll_precision == 0)
+        {
+            throw std::invalid_argument("Autoscaler target_items_per_bucket needs a sketch with hll_precision for estimate_distinct.");
+        }
+    }
+
+    void update(uint64_t item)
+    {
+        m_sketch.update(item);
+        _tick();
+    }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        m_sketch.update(item, weight);
+        _tick();
+    }
+
+    // Evaluates the signals and performs at most one structural operation; called automatically every check_interval updates
+    Action check()
+    {
+        m_updates_since_check = 0;
+        uint32_t width = m_sketch.get_width();
+        uint32_t max_width = _max_width();
+
+        // Over budget (e.g. after set_memory_budget): shrink right away, the rate limit does not apply
+        if (width > max_width) return _resize(max_width);
+        if (m_updates_since_resize < m_config.min_items_between_resizes) return Action::None;
+
+        uint32_t target = get_target_width();
+        if (target > width * (1.0 + m_config.hysteresis))
+        {
+            uint32_t new_width = std::min<uint32_t>(target, std::ceil(width * m_config.growth_factor));
+            if (m_config.max_load_skew > 0.0 && get_load_skew() > m_config.max_load_skew) m_skew_floor = std::max(m_skew_floor, new_width);
+            return _resize(new_width);
+        }
+        if (target < width * (1.0 - m_config.hysteresis)) return _resize(std::max<uint32_t>(target, std::floor(width / m_config.growth_factor)));
+        return Action::None;
+    }
+
+    // Width the signals ask for, clamped to [min_width, max width within the budget]
+    uint32_t get_target_width() const
+    {
+        uint32_t width = m_sketch.get_width();
+        double target = width;
+        if (m_config.target_items_per_bucket > 0.0)
+        {
+            target = std::ceil(m_sketch.estimate_distinct() / m_config.target_items_per_bucket);
+        }
+        // Skew only counts once the buckets are as full as the target asks; below that, balls-in-bins noise alone makes max/mean large
+        if (target >= width && m_config.max_load_skew > 0.0 && get_load_skew() > m_config.max_load_skew) target = std::max(target, std::ceil(width * m_config.growth_factor));
+        target = std::max<double>(target, m_skew_floor);
+        // The budget wins over min_width, otherwise a min_width above it would have check() shrink to the budget and expand back
+        uint32_t max_width = _max_width();
+        return std::clamp<uint32_t>(static_cast<uint32_t>(std::min(target, 4294967295.0)), std::min(m_config.min_width, max_width), max_width);
+    }
+
+    // Largest bucket count over the mean bucket count, averaged over the rows, relative to what a balanced stream shows at this width
+    // (1 = no worse than uniform items). With v points per bucket the widest bucket owns about 1 + max(ln(w) / v, sqrt(2 ln(w) / v)) times
+    // its share of the ring, plus sqrt(2 ln(w) / mean) of sampling noise; without this baseline a wider sketch looks more skewed by itself
+    double get_load_skew() const
+    {
+        uint32_t width = m_sketch.get_width();
+        double mean = static_cast<double>(_total_count()) / width;
+        if (mean < min_mean_count_for_skew) return 1.0;
+        double log_width = std::log(static_cast<double>(width));
+        double points = std::max(m_sketch.get_config().virtual_nodes, 1u);
+        double baseline = 1.0 + std::max(log_width / points, std::sqrt(2.0 * log_width / points)) + std::sqrt(2.0 * log_width / mean);
+
+        double skew = 0.0;
+        for (uint32_t i = 0; i < m_sketch.get_depth(); ++i)
+        {
+            uint64_t max_count = 0;
+            for (uint32_t j = 0; j < width; ++j) max_count = std::max(max_count, m_sketch.get_bucket_count(i, j));
+            skew += static_cast<double>(max_count) / mean;
+        }
+        return skew / (m_sketch.get_depth() * baseline);
+    }
+
+    void set_memory_budget(uint32_t memory_budget) { m_config.memory_budget = memory_budget; }
+
+    const ReSketchAutoscalerConfig &get_config() const { return m_config; }
+    uint64_t get_num_expansions() const { return m_num_expansions; }
+    uint64_t get_num_shrinks() const { return m_num_shrinks; }
+    uint32_t get_skew_floor() const { return m_skew_floor; }
+
+private:
+    void _tick()
+    {
+        ++m_updates_since_resize;
+        if (++m_updates_since_check >= m_config.check_interval) check();
+    }
+
+    Action _resize(uint32_t new_width)
+    {
+        uint32_t width = m_sketch.get_width();
+        if (new_width == width || new_width == 0) return Action::None;
+        m_updates_since_resize = 0;
+        if (new_width > width)
+        {
+            m_sketch.expand(new_width);
+            ++m_num_expansions;
+            return Action::Expand;
+        }
+        m_sketch.shrink(new_width);
+        ++m_num_shrinks;
+        return Action::Shrink;
+    }
+
+    uint32_t _max_width() const { return m_sketch.calculate_max_width(m_config.memory_budget); }
+
+    // Every row sums to the total ingested weight
+    uint64_t _total_count() const
+    {
+        uint64_t total = 0;
+        for (uint32_t j = 0; j < m_sketch.get_width(); ++j) total += m_sketch.get_bucket_count(0, j);
+        return total;
+    }
+
+    Sketch &m_sketch;
+    ReSketchAutoscalerConfig m_config;
+    uint64_t m_updates_since_check = 0;
+    uint64_t m_updates_since_resize = 0;
+    uint64_t m_num_expansions = 0;
+    uint64_t m_num_shrinks = 0;
+    uint32_t m_skew_floor = 0;   // widest width a skew-driven expand reached
+};
@@ -0,0 +1,465 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary/resketchv2.hpp"
+#include "hash/xxhash64.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Many tenant sketches (e.g. one per customer) in one pool. Seeds, placement hash parameters and rings live in immutable topologies shared
+// by every tenant on the same ones, so a tenant holds its buckets and side structures only. Fresh tenants all start on the pool's base
+// topology; expand, shrink and merges across topologies give the tenant a new one (copy-on-write), and equal topologies are deduplicated.
+// Bucket arrays are InlineKLL buckets carved from per-size slabs and recycled on spill or drop. Beyond max_resident_tenants, the least
+// recently used tenants are serialized to the spill directory and reloaded on their next access.
+// A tenant's partition ranges are not kept. Spill files belong to the pool and are removed with it. Not thread-safe.
+template <uint16_t K = 64> class ReSketchPool
+{
+public:
+    using Sketch = InlineReSketchV2<K>;
+    using Summary = InlineKLL<K>;
+    using Ring = typename Sketch::Ring;
+
+private:
+    // Everything of a sketch but its buckets and side structures
+    struct Topology
+    {
+        ReSketchConfig config;   // with the width and depth of these rings
+        uint32_t partition_seed;
+        std::vector<uint32_t> seeds;
+        std::vector<uint64_t> a;   // placement hash a * partition_hash + b, per row
+        std::vector<uint64_t> b;
+        std::vector<Ring> rings;
+
+        bool operator==(const Topology &other) const
+        {
+            const ReSketchConfig &c = config, &o = other.config;
+            return c.width == o.width && c.depth == o.depth && c.kll_k == o.kll_k && c.top_k_candidates == o.top_k_candidates &&
+                   c.invertible_partition_hash == o.invertible_partition_hash && c.hll_precision == o.hll_precision && c.load_aware_resize == o.load_aware_resize &&
+                   c.virtual_nodes == o.virtual_nodes && partition_seed == other.partition_seed && seeds == other.seeds && rings == other.rings;
+        }
+
+        size_t get_memory_usage() const
+        {
+            size_t bytes = sizeof(Topology) + seeds.size() * sizeof(uint32_t) + (a.size() + b.size()) * sizeof(uint64_t);
+            for (const auto &ring : rings) bytes += sizeof(Ring) + ring.size() * sizeof(typename Ring::value_type);
+            return bytes;
+        }
+    };
+
+    struct Bucket
+    {
+        uint64_t count = 0;
+        Summary summary;
+    };
+
+    struct Tenant
+    {
+        std::shared_ptr<const Topology> topology;   // null while spilled
+        Bucket *buckets = nullptr;                  // depth * width, row-major, from the slabs
+        SpaceSaving candidates;
+        HyperLogLog distinct;
+        std::list<uint64_t>::iterator lru_position;   // valid while resident
+    };
+
+    // Bucket arrays of one size are carved from slabs and recycled through a free list; slabs are released with the pool.
+    // Blocks are handed out as they are, the caller overwrites every bucket
+    class Slabs
+    {
+    public:
+        explicit Slabs(size_t slab_bytes) : m_slab_bytes(slab_bytes) {}
+
+        Bucket *allocate(size_t num_buckets)
+        {
+            SizeClass &size_class = m_size_classes[num_buckets];
+            if (size_class.free.empty())
+            {
+                size_t blocks_per_slab = std::max<size_t>(1, m_slab_bytes / (num_buckets * sizeof(Bucket)));
+                size_class.slabs.push_back(std::make_unique<Bucket[]>(blocks_per_slab * num_buckets));
+                m_bytes += blocks_per_slab * num_buckets * sizeof(Bucket);
+                for (size_t i = blocks_per_slab; i-- > 0;) size_class.free.push_back(size_class.slabs.back().get() + i * num_buckets);
+            }
+            Bucket *block = size_class.free.back();
+            size_class.free.pop_back();
+            return block;
+        }
+
+        void release(Bucket *block, size_t num_buckets) { m_size_classes[num_buckets].free.push_back(block); }
+
+        size_t get_bytes() const { return m_bytes; }
+
+    private:
+        struct SizeClass
+        {
+            std::vector<std::unique_ptr<Bucket[]>> slabs;
+            std::vector<Bucket *> free;
+        };
+
+        size_t m_slab_bytes;
+        size_t m_bytes = 0;
+        std::unordered_map<size_t, SizeClass> m_size_classes;
+    };
+
+    static_assert(summary_hash_bits<Summary> == 64, "The pool computes full 64-bit placement hashes.");
+
+public:
+    // sketch_config defines the base topology of new tenants
+    ReSketchPool(const ReSketchConfig &sketch_config, const ReSketchPoolConfig &config)
+        : m_config(config), m_spill_directory(config.spill_directory), m_slabs(static_cast<size_t>(std::max(config.slab_size_kb, 1u)) << 10)
+    {
+        std::filesystem::create_directories(m_spill_directory);
+        m_base = _intern(Sketch(sketch_config));
+    }
+
+    ReSketchPool(const ReSketchPool &) = delete;
+    ReSketchPool &operator=(const ReSketchPool &) = delete;
+
+    ~ReSketchPool()
+    {
+        for (const auto &[id, tenant] : m_tenants)
+        {
+            if (!tenant.topology) std::filesystem::remove(_spill_path(id));
+        }
+    }
+
+    // Empty tenant on the base topology: tenants created this way merge bucket by bucket
+    void create(uint64_t tenant)
+    {
+        if (m_tenants.contains(tenant)) { throw std::invalid_argument("Tenant " + std::to_string(tenant) + " already exists."); }
+        Tenant &t = m_tenants[tenant];
+        const Topology &base = *m_base;
+        t.topology = m_base;
+        size_t num_buckets = static_cast<size_t>(base.config.depth) * base.config.width;
+        t.buckets = m_slabs.allocate(num_buckets);
+        // A recycled block holds a former tenant's buckets; each summary also gets its own compaction random state
+        for (size_t i = 0; i < num_buckets; ++i) t.buckets[i] = Bucket{};
+        t.candidates = SpaceSaving(base.config.top_k_candidates);
+        t.distinct = HyperLogLog(base.config.hll_precision);
+        t.lru_position = m_lru.insert(m_lru.begin(), tenant);
+        _evict_cold();
+    }
+
+    // Creates or replaces a tenant with the contents of sketch; its topology is shared if another tenant has the same one
+    void put(uint64_t tenant, const Sketch &sketch)
+    {
+        auto [it, inserted] = m_tenants.try_emplace(tenant);
+        Tenant &t = it->second;
+        bool resident = !inserted && t.topology;
+        if (!inserted && !resident) std::filesystem::remove(_spill_path(tenant));
+        _store(t, sketch);
+        if (resident) m_lru.splice(m_lru.begin(), m_lru, t.lru_position);
+        else
+        {
+            t.lru_position = m_lru.insert(m_lru.begin(), tenant);
+        }
+        _evict_cold();
+    }
+
+    // A standalone copy of the tenant's sketch
+    Sketch get(uint64_t tenant)
+    {
+        Sketch sketch = _materialize(_resident(tenant));
+        _evict_cold();
+        return sketch;
+    }
+
+    void drop(uint64_t tenant)
+    {
+        auto it = m_tenants.find(tenant);
+        if (it == m_tenants.end()) { throw std::invalid_argument("No tenant " + std::to_string(tenant) + "."); }
+        Tenant &t = it->second;
+        if (t.topology)
+        {
+            m_slabs.release(t.buckets, _num_buckets(t));
+            m_lru.erase(t.lru_position);
+        }
+        else
+        {
+            std::filesystem::remove(_spill_path(tenant));
+        }
+        m_tenants.erase(it);
+    }
+
+    bool contains(uint64_t tenant) const { return m_tenants.contains(tenant); }
+
+    void update(uint64_t tenant, uint64_t item, uint64_t weight = 1)
+    {
+        if (weight == 0) return;
+        _update(_resident(tenant), item, weight);
+        _evict_cold();
+    }
+
+    void update(uint64_t tenant, std::span<const std::pair<uint64_t, uint64_t>> weighted_items)
+    {
+        Tenant &t = _resident(tenant);
+        for (const auto &[item, weight] : weighted_items)
+        {
+            if (weight != 0) _update(t, item, weight);
+        }
+        _evict_cold();
+    }
+
+    // Same estimate as the tenant's sketch: the median of the rows
+    double estimate(uint64_t tenant, uint64_t item)
+    {
+        const Tenant &t = _resident(tenant);
+        const Topology &topology = *t.topology;
+        uint32_t depth = topology.config.depth;
+        uint64_t partition_h = Sketch::compute_partition_hash(item, topology.partition_seed, topology.config.invertible_partition_hash);
+        m_estimates.resize(depth);
+        for (uint32_t i = 0; i < depth; ++i)
+        {
+            uint64_t h = topology.a[i] * partition_h + topology.b[i];
+            m_estimates[i] = t.buckets[i * topology.config.width + Sketch::find_bucket_id(h, topology.rings[i])].summary.estimate(h);
+        }
+        _evict_cold();
+        std::sort(m_estimates.begin(), m_estimates.end());
+        if (depth % 2 == 0) { return (m_estimates[depth / 2 - 1] + m_estimates[depth / 2]) / 2.0; }
+        else
+        {
+            return m_estimates[depth / 2];
+        }
+    }
+
+    void expand(uint64_t tenant, uint32_t new_width)
+    {
+        Tenant &t = _resident(tenant);
+        Sketch sketch = _materialize(t);
+        sketch.expand(new_width);
+        _store(t, sketch);
+        _evict_cold();
+    }
+
+    void shrink(uint64_t tenant, uint32_t new_width)
+    {
+        Tenant &t = _resident(tenant);
+        Sketch sketch = _materialize(t);
+        sketch.shrink(new_width);
+        _store(t, sketch);
+        _evict_cold();
+    }
+
+    // Merges source into destination; tenants on the same topology merge bucket by bucket, others through ReSketchV2::merge
+    void merge(uint64_t destination, uint64_t source)
+    {
+        if (destination == source) { throw std::invalid_argument("Cannot merge a tenant into itself."); }
+        const Tenant &s = _resident(source);
+        Tenant &d = _resident(destination);
+        if (d.topology == s.topology)
+        {
+            for (size_t i = 0, n = _num_buckets(d); i < n; ++i)
+            {
+                d.buckets[i].count += s.buckets[i].count;
+                d.buckets[i].summary.merge(s.buckets[i].summary);
+            }
+            d.candidates = SpaceSaving::merge(d.candidates, s.candidates);
+            d.distinct.merge(s.distinct);
+        }
+        else
+        {
+            _store(d, Sketch::merge(_materialize(d), _materialize(s)));
+        }
+        _evict_cold();
+    }
+
+    size_t get_num_tenants() const { return m_tenants.size(); }
+    size_t get_num_resident_tenants() const { return m_lru.size(); }
+
+    // Distinct topologies in use
+    size_t get_num_topologies() const
+    {
+        size_t count = 0;
+        for (const auto &[fingerprint, topology] : m_topologies) count += !topology.expired();
+        return count;
+    }
+
+    // Bytes of bucket slabs, including free blocks kept for reuse
+    size_t get_slab_bytes() const { return m_slabs.get_bytes(); }
+
+    // Bytes of the shared topologies, each counted once
+    size_t get_topology_bytes() const
+    {
+        size_t bytes = 0;
+        for (const auto &[fingerprint, weak] : m_topologies)
+        {
+            if (auto topology = weak.lock()) bytes += topology->get_memory_usage();
+        }
+        return bytes;
+    }
+
+    const ReSketchPoolConfig &get_config() const { return m_config; }
+
+private:
+    static size_t _num_buckets(const Tenant &t) { return static_cast<size_t>(t.topology->config.depth) * t.topology->config.width; }
+
+    std::filesystem::path _spill_path(uint64_t tenant) const { return m_spill_directory / ("tenant_" + std::to_string(tenant) + ".rsv2"); }
+
+    void _update(Tenant &t, uint64_t item, uint64_t weight)
+    {
+        const Topology &topology = *t.topology;
+        t.candidates.update(item, weight);
+        uint64_t partition_h = Sketch::compute_partition_hash(item, topology.partition_seed, topology.config.invertible_partition_hash);
+        t.distinct.update_hash(partition_h);
+        for (uint32_t i = 0; i < topology.config.depth; ++i)
+        {
+            uint64_t h = topology.a[i] * partition_h + topology.b[i];
+            Bucket &bucket = t.buckets[i * topology.config.width + Sketch::find_bucket_id(h, topology.rings[i])];
+            bucket.count += weight;
+            if (weight == 1) bucket.summary.update(h);
+            else
+            {
+                bucket.summary.update(h, weight);
+            }
+        }
+    }
+
+    // The tenant, reloaded if it was spilled, as the most recently used; spilling waits for _evict_cold so that a call's tenants stay loaded
+    Tenant &_resident(uint64_t tenant)
+    {
+        auto it = m_tenants.find(tenant);
+        if (it == m_tenants.end()) { throw std::invalid_argument("No tenant " + std::to_string(tenant) + "."); }
+        Tenant &t = it->second;
+        if (t.topology)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, t.lru_position);
+            return t;
+        }
+
+        std::filesystem::path path = _spill_path(tenant);
+        std::ifstream in(path, std::ios::binary);
+        if (!in) { throw std::runtime_error("Cannot open " + path.string() + "."); }
+        _store(t, Sketch::deserialize(in));
+        in.close();
+        std::filesystem::remove(path);
+        t.lru_position = m_lru.insert(m_lru.begin(), tenant);
+        return t;
+    }
+
+    // Spills the least recently used tenants beyond max_resident_tenants
+    void _evict_cold()
+    {
+        if (m_config.max_resident_tenants == 0) return;
+        while (m_lru.size() > m_config.max_resident_tenants)
+        {
+            uint64_t tenant = m_lru.back();
+            Tenant &t = m_tenants.at(tenant);
+            std::filesystem::path path = _spill_path(tenant);
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            _materialize(t).serialize(out);
+            out.flush();
+            if (!out) { throw std::runtime_error("Failed to spill to " + path.string() + "."); }
+            m_slabs.release(t.buckets, _num_buckets(t));
+            t.buckets = nullptr;
+            t.topology.reset();
+            t.candidates = SpaceSaving();
+            t.distinct = HyperLogLog();
+            m_lru.pop_back();
+        }
+    }
+
+    Sketch _materialize(const Tenant &t) const
+    {
+        const Topology &topology = *t.topology;
+        Sketch sketch(topology.config, topology.seeds, topology.partition_seed, topology.rings);
+        for (uint32_t i = 0; i < topology.config.depth; ++i)
+        {
+            for (uint32_t j = 0; j < topology.config.width; ++j)
+            {
+                const Bucket &bucket = t.buckets[i * topology.config.width + j];
+                if (bucket.count != 0) sketch.merge_into_bucket(i, j, bucket.count, bucket.summary);
+            }
+        }
+        sketch.merge_side_structures(t.candidates, t.distinct);
+        return sketch;
+    }
+
+    // Replaces the tenant's contents with the sketch's
+    void _store(Tenant &t, const Sketch &sketch)
+    {
+        std::shared_ptr<const Topology> topology = _intern(sketch);
+        size_t width = sketch.get_width();
+        Bucket *buckets = m_slabs.allocate(sketch.get_depth() * width);
+        sketch.for_each_bucket([&](uint32_t row, uint32_t bucket_id, uint64_t count, const Summary &summary) { buckets[row * width + bucket_id] = {count, summary}; });
+        if (t.buckets) m_slabs.release(t.buckets, _num_buckets(t));
+        t.buckets = buckets;
+        t.topology = std::move(topology);
+        t.candidates = sketch.get_candidates();
+        t.distinct = sketch.get_distinct_sketch();
+    }
+
+    // The shared topology equal to the sketch's, created if no tenant uses one
+    std::shared_ptr<const Topology> _intern(const Sketch &sketch)
+    {
+        auto topology = std::make_shared<Topology>();
+        topology->config = sketch.get_config();
+        topology->config.width = sketch.get_width();
+        topology->config.depth = sketch.get_depth();
+        topology->partition_seed = sketch.get_partition_seed();
+        topology->seeds.assign(sketch.get_seeds().begin(), sketch.get_seeds().end());
+        for (uint32_t i = 0; i < sketch.get_depth(); ++i)
+        {
+            auto [a, b] = sketch.get_row_hash_parameters(i);
+            topology->a.push_back(a);
+            topology->b.push_back(b);
+        }
+        topology->rings.assign(sketch.get_rings().begin(), sketch.get_rings().end());
+
+        // Field by field: a ring point is a padded pair, and its padding bytes are not part of the topology
+        XXHash64 hasher(topology->partition_seed);
+        hasher.add(topology->seeds.data(), topology->seeds.size() * sizeof(uint32_t));
+        hasher.add(topology->a.data(), topology->a.size() * sizeof(uint64_t));
+        hasher.add(topology->b.data(), topology->b.size() * sizeof(uint64_t));
+        for (const auto &ring : topology->rings)
+        {
+            for (const auto &[position, bucket] : ring)
+            {
+                hasher.add(&position, sizeof(position));
+                hasher.add(&bucket, sizeof(bucket));
+            }
+        }
+        uint64_t fingerprint = hasher.hash();
+
+        auto [begin, end] = m_topologies.equal_range(fingerprint);
+        for (auto it = begin; it != end;)
+        {
+            if (auto existing = it->second.lock())
+            {
+                if (*existing == *topology) return existing;
+                ++it;
+            }
+            else
+            {
+                it = m_topologies.erase(it);
+            }
+        }
+        m_topologies.emplace(fingerprint, topology);
+        // Topologies no tenant uses any more are otherwise only noticed on a fingerprint collision
+        if (m_topologies.size() >= 2 * m_topologies_after_sweep)
+        {
+            std::erase_if(m_topologies, [](const auto &entry) { return entry.second.expired(); });
+            m_topologies_after_sweep = std::max<size_t>(m_topologies.size(), 16);
+        }
+        return topology;
+    }
+
+    ReSketchPoolConfig m_config;
+    std::filesystem::path m_spill_directory;
+    Slabs m_slabs;   // before the tenants pointing into it
+    std::unordered_multimap<uint64_t, std::weak_ptr<const Topology>> m_topologies;   // by fingerprint
+    size_t m_topologies_after_sweep = 16;
+    std::shared_ptr<const Topology> m_base;
+    std::unordered_map<uint64_t, Tenant> m_tenants;
+    std::list<uint64_t> m_lru;   // resident tenants, most recently used first
+    std::vector<double> m_estimates;
+};
@@ -3,37 +3,78 @@
 #include "frequency_summary_config.hpp"
 
 #include "frequency_summary.hpp"
+#include "cardinality_summary/hyperloglog.hpp"
+#include "frequency_summary/space_saving.hpp"
+#include "hash/invertible_mix64.hpp"
 #include "hash/xxhash64.hpp"
+#include "quantile_summary/bucket_summary.hpp"
+#include "quantile_summary/hybrid_summary.hpp"
+#include "quantile_summary/kll.hpp"
+#include "quantile_summary/kll_compact.hpp"
 #include "quantile_summary/kll_datasketches.hpp"
+#include "quantile_summary/kll_inline.hpp"
+#include "quantile_summary/lazy_summary.hpp"
+
+#include "utils/BinaryStream.hpp"
+#include "utils/SortingNetwork.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <istream>
 #include <limits>
 #include <map>
+#include <numeric>
+#include <ostream>
+#include <queue>
 #include <random>
 #include <set>
+#include <span>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-// using KLL = KLLXX;
-class ReSketchV2 : public FrequencySummary
+// Summary is the quantile summary kept in every bucket, e.g. KLL (Apache DataSketches) or KLLXX.
+// Depth = 0 keeps the depth a runtime value; a non-zero Depth fixes it at compile time, stores the per-row state in std::arrays and unrolls the row loops.
+template <BucketSummary Summary = KLL, uint32_t Depth = 0> class BasicReSketchV2 : public FrequencySummary
 {
 private:
+    static constexpr bool is_fixed_depth = Depth != 0;
+
+    // Bounds for adaptive k: DataSketches KLL needs k >= 8; a hot bucket may take up to 8x the configured k
+    static constexpr uint32_t min_adaptive_k = 8;
+    static constexpr uint32_t max_adaptive_k_factor = 8;
+
+    // Compact mode: buckets keep 32-bit fingerprints, so placement hashes live in the upper 32 bits and ring points are quantized to match
+    static constexpr bool is_compact = summary_hash_bits<Summary> == 32;
+    static constexpr uint64_t low_mask = 0xFFFFFFFFULL;
+
+    template <typename T> using RowArray = std::conditional_t<is_fixed_depth, std::array<T, Depth>, std::vector<T>>;
+
     struct Bucket
     {
         uint64_t count = 0;
-        KLL q_sketch;
+        Summary q_sketch;
 
         Bucket() = default;
 
         explicit Bucket(const KLLConfig &kll_config) : q_sketch(kll_config) {}
     };
 
+    // Binary format (serialize/deserialize): "RSV2" and a version
+    static constexpr uint32_t serial_magic = 0x32565352;
+    static constexpr uint32_t serial_version = 2;
+
+public:
     // A ring is a sorted list of pairs: {hash_point, bucket_id}
     using Ring = std::vector<std::pair<uint64_t, uint32_t>>;
+    using SummaryType = Summary;
 
-public:
-    explicit ReSketchV2(const ReSketchConfig &config) : m_config(config), m_width(config.width), m_depth(config.depth), m_kll_config({config.kll_k})
+    explicit BasicReSketchV2(const ReSketchConfig &config)
+        : m_config(config), m_width(config.width), m_depth(config.depth), m_kll_config({config.kll_k}), m_candidates(config.top_k_candidates), m_distinct(config.hll_precision)
     {
+        _check_config();
         _initialize_seeds();
         _initialize_pairwise_hash_family();
         _initialize_buckets();
@@ -41,46 +82,155 @@ public:
         m_partition_ranges = {{0, std::numeric_limits<uint64_t>::max()}};
     }
 
-    ReSketchV2(uint32_t depth, uint32_t width, const std::vector<uint32_t> &seeds, uint32_t kll_k, uint32_t partition_seed)
-        : m_width(width), m_depth(depth), m_seeds(seeds), m_partition_seed(partition_seed), m_kll_config({kll_k})
+    BasicReSketchV2(uint32_t depth, uint32_t width, std::span<const uint32_t> seeds, uint32_t kll_k, uint32_t partition_seed)
+        : m_width(width), m_depth(depth), m_seeds(_to_rows(seeds)), m_partition_seed(partition_seed), m_kll_config({kll_k})
     {
         m_config = {m_width, m_depth, kll_k};
+        _check_config();
         _initialize_pairwise_hash_family();
         _initialize_buckets();
         _initialize_rings();
         m_partition_ranges = {{0, std::numeric_limits<uint64_t>::max()}};
     }
 
-    ReSketchV2(uint32_t depth, uint32_t width, const std::vector<uint32_t> &seeds, uint32_t kll_k, uint32_t partition_seed, const std::vector<Ring> &rings)
-        : m_width(width), m_depth(depth), m_seeds(seeds), m_partition_seed(partition_seed), m_kll_config({kll_k}), m_rings(rings)
+    BasicReSketchV2(uint32_t depth, uint32_t width, std::span<const uint32_t> seeds, uint32_t kll_k, uint32_t partition_seed, std::span<const Ring> rings)
+        : m_width(width), m_depth(depth), m_seeds(_to_rows(seeds)), m_partition_seed(partition_seed), m_kll_config({kll_k}), m_rings(_to_rows(rings))
     {
         m_config = {m_width, m_depth, kll_k};
+        _check_config();
+        for (auto &ring : m_rings)
+        {
+            for (auto &point : ring) { point.first = _quantize_point(point.first); }
+        }
         _initialize_pairwise_hash_family();
         _initialize_buckets();
         m_partition_ranges = {{0, std::numeric_limits<uint64_t>::max()}};
     }
 
+    // Empty sketch on the given seeds and rings with every option of config (width and depth are taken from config), e.g. to rebuild a sketch
+    // whose buckets were stored elsewhere
+    BasicReSketchV2(const ReSketchConfig &config, std::span<const uint32_t> seeds, uint32_t partition_seed, std::span<const Ring> rings)
+        : BasicReSketchV2(config.depth, config.width, seeds, config.kll_k, partition_seed, rings)
+    {
+        m_config = config;
+        _check_config();
+        m_candidates = SpaceSaving(config.top_k_candidates);
+        m_distinct = HyperLogLog(config.hll_precision);
+    }
+
     void update(uint64_t item) override
     {
+        m_candidates.update(item);
+        uint64_t partition_h = _partition_hash(item);
+        m_distinct.update_hash(partition_h);
+        _for_each_row(
+            [&](uint32_t i)
+            {
+                uint64_t h = _placement_hash_from_partition(partition_h, i);
+                uint32_t id = _find_bucket_id(h, m_rings[i]);
+                m_buckets[i][id].count++;
+                m_buckets[i][id].q_sketch.update(h);
+            });
+    }
+
+    // Weighted update (byte counts, pre-aggregated records): one (hash, weight) insertion per bucket, O(log weight) in the KLL
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        m_candidates.update(item, weight);
+        uint64_t partition_h = _partition_hash(item);
+        m_distinct.update_hash(partition_h);
+        _for_each_row(
+            [&](uint32_t i)
+            {
+                uint64_t h = _placement_hash_from_partition(partition_h, i);
+                uint32_t id = _find_bucket_id(h, m_rings[i]);
+                m_buckets[i][id].count += weight;
+                m_buckets[i][id].q_sketch.update(h, weight);
+            });
+    }
+
+    // Batch of (item, weight) pairs: per row the records are sorted by bucket, so each touched bucket is visited once and the cost scales with
+    // the batch, not the width (a counting sort only once the batch covers the row). Unit weights take the plain update path; a bucket's
+    // heavier records are merged in as one summary.
+    void update(std::span<const std::pair<uint64_t, uint64_t>> weighted_items)
+    {
+        std::vector<uint64_t> partition_hashes;
+        partition_hashes.reserve(weighted_items.size());
+        for (const auto &[item, weight] : weighted_items)
+        {
+            partition_hashes.push_back(_partition_hash(item));
+            // As in update(item, 0), a zero-weight record is not an occurrence
+            if (weight == 0) continue;
+            m_candidates.update(item, weight);
+            m_distinct.update_hash(partition_hashes.back());
+        }
+
+        std::vector<uint64_t> placement_hashes(weighted_items.size());
+        std::vector<uint64_t> placed;   // bucket_id << 32 | record index, sorted to group the records by bucket
+        placed.reserve(weighted_items.size());
+        std::vector<uint64_t> sorted;
+        std::vector<uint32_t> offsets;
+        std::vector<std::pair<uint64_t, uint64_t>> group;
         for (uint32_t i = 0; i < m_depth; ++i)
         {
-            uint64_t h = _placement_hash(item, i);
-            uint32_t id = _find_bucket_id(h, m_rings[i]);
-            m_buckets[i][id].count++;
-            m_buckets[i][id].q_sketch.update(h);
+            placed.clear();
+            for (size_t j = 0; j < weighted_items.size(); ++j)
+            {
+                if (weighted_items[j].second == 0) continue;
+                placement_hashes[j] = _placement_hash_from_partition(partition_hashes[j], i);
+                placed.push_back(static_cast<uint64_t>(_find_bucket_id(placement_hashes[j], m_rings[i])) << 32 | j);
+            }
+            if (placed.size() < m_buckets[i].size()) std::sort(placed.begin(), placed.end());
+            else
+            {
+                offsets.assign(m_buckets[i].size() + 1, 0);
+                for (uint64_t key : placed) ++offsets[(key >> 32) + 1];
+                for (size_t id = 1; id < offsets.size(); ++id) offsets[id] += offsets[id - 1];
+                sorted.resize(placed.size());
+                for (uint64_t key : placed) sorted[offsets[key >> 32]++] = key;
+                placed.swap(sorted);
+            }
+
+            for (size_t begin = 0; begin < placed.size();)
+            {
+                uint32_t id = static_cast<uint32_t>(placed[begin] >> 32);
+                auto &bucket = m_buckets[i][id];
+                group.clear();
+                size_t end = begin;
+                for (; end < placed.size() && static_cast<uint32_t>(placed[end] >> 32) == id; ++end)
+                {
+                    uint32_t j = static_cast<uint32_t>(placed[end]);
+                    uint64_t weight = weighted_items[j].second;
+                    bucket.count += weight;
+                    if (weight == 1) bucket.q_sketch.update(placement_hashes[j]);
+                    else
+                        group.emplace_back(placement_hashes[j], weight);
+                }
+
+                if (group.size() == 1) { bucket.q_sketch.update(group[0].first, group[0].second); }
+                else if (group.size() > 1)
+                {
+                    bucket.q_sketch.merge(Summary::construct_from_weighted_items(group, bucket.q_sketch.get_config()));
+                }
+                begin = end;
+            }
         }
     }
 
     double estimate(uint64_t item) const override
     {
-        std::vector<double> estimates;
-        estimates.reserve(m_depth);
-        for (uint32_t i = 0; i < m_depth; ++i)
+        uint64_t partition_h = _partition_hash(item);
+        if constexpr (is_fixed_depth)
         {
-            uint64_t h = _placement_hash(item, i);
-            uint32_t id = _find_bucket_id(h, m_rings[i]);
-            estimates.push_back(m_buckets[i][id].q_sketch.estimate(h));
+            std::array<double, Depth> estimates;
+            _for_each_row([&](uint32_t i) { estimates[i] = _row_estimate(partition_h, i); });
+            return SortingNetwork<Depth>::median(estimates);
         }
+
+        std::vector<double> estimates;
+        estimates.reserve(m_depth);
+        for (uint32_t i = 0; i < m_depth; ++i) { estimates.push_back(_row_estimate(partition_h, i)); }
         std::sort(estimates.begin(), estimates.end());
         if (m_depth % 2 == 0) { return (estimates[m_depth / 2 - 1] + estimates[m_depth / 2]) / 2.0; }
         else
@@ -89,6 +239,25 @@ public:
         }
     }
 
+    void estimate_batch(std::span<const uint64_t> items, std::span<double> estimates) const
+    {
+        if (estimates.size() < items.size()) { throw std::invalid_argument("Output span is smaller than the batch."); }
+        for (size_t j = 0; j < items.size(); ++j) estimates[j] = estimate(items[j]);
+    }
+
+    // Builds the read caches that const queries would otherwise create lazily (the sorted view of a DataSketches KLL), so that afterwards
+    // estimate and estimate_batch only read and any number of threads may query the sketch while nobody updates it
+    void prepare_concurrent_reads() const
+    {
+        for (const auto &row : m_buckets)
+        {
+            for (const auto &bucket : row)
+            {
+                if (bucket.count > 0) bucket.q_sketch.estimate(0);
+            }
+        }
+    }
+
     // --- Structure-defining Operations ---
 
     void expand(uint32_t new_width)
@@ -101,14 +270,21 @@ public:
         for (uint32_t i = 0; i < m_depth; ++i)
         {
             Ring new_ring = m_rings[i];
-            for (uint32_t j = 0; j < new_width - m_width; ++j) { new_ring.push_back({dist(rng), m_width + j}); }
+            uint32_t num_new_points = 0;
+            if (m_config.load_aware_resize) num_new_points = _split_heaviest_arcs(i, new_width - m_width, new_ring);
+            // Uniformly random points, also for whatever the load-aware split could not place
+            for (uint32_t j = num_new_points; j < new_width - m_width; ++j)
+            {
+                for (uint32_t v = 0; v < _virtual_nodes(); ++v) { new_ring.push_back({_quantize_point(dist(rng)), m_width + j}); }
+            }
             std::sort(new_ring.begin(), new_ring.end());
 
-            std::vector<Bucket> new_buckets = _remap_row(m_rings[i], m_buckets[i], new_ring);
+            std::vector<Bucket> new_buckets = _remap_row(m_rings[i], m_buckets[i], new_ring, new_width, m_kll_config);
             m_rings[i] = new_ring;
             m_buckets[i] = std::move(new_buckets);
         }
         m_width = new_width;
+        if (m_config.adaptive_k) rebalance_kll_k();
     }
 
     void shrink(uint32_t new_width)
@@ -119,30 +295,54 @@ public:
 
         for (uint32_t i = 0; i < m_depth; ++i)
         {
-            Ring new_ring = m_rings[i];
-            std::shuffle(new_ring.begin(), new_ring.end(), rng);
-            new_ring.resize(new_width);
-
-            //  reindex the bucket_id of the new ring
-            std::sort(
-                new_ring.begin(), new_ring.end(),
-                [](const auto &a, const auto &b)
-                {
-                    return a.second < b.second;
-                });
+            // Buckets are kept or dropped with all their points (virtual nodes)
+            std::vector<bool> kept(m_width, false);
+            if (m_config.load_aware_resize) { kept = _drop_lightest_buckets(i, new_width); }
+            else
+            {
+                std::vector<uint32_t> bucket_ids(m_width);
+                std::iota(bucket_ids.begin(), bucket_ids.end(), 0);
+                std::shuffle(bucket_ids.begin(), bucket_ids.end(), rng);
+                for (uint32_t j = 0; j < new_width; ++j) kept[bucket_ids[j]] = true;
+            }
 
-            for (uint32_t j = 0; j < new_ring.size(); ++j)
+            //  reindex the bucket_id of the new ring, keeping the order of the surviving ids
+            std::vector<uint32_t> new_ids(m_width);
+            for (uint32_t id = 0, next_id = 0; id < m_width; ++id)
             {
-                new_ring[j].second = j;   // Reassign bucket IDs
+                if (kept[id]) new_ids[id] = next_id++;   // Reassign bucket IDs
             }
 
-            std::sort(new_ring.begin(), new_ring.end());
+            Ring new_ring;
+            new_ring.reserve(m_rings[i].size());
+            for (const auto &[point, id] : m_rings[i])
+            {
+                if (kept[id]) new_ring.push_back({point, new_ids[id]});
+            }
 
-            std::vector<Bucket> new_buckets = _remap_row(m_rings[i], m_buckets[i], new_ring);
+            std::vector<Bucket> new_buckets = _remap_row(m_rings[i], m_buckets[i], new_ring, new_width, m_kll_config);
             m_rings[i] = new_ring;
             m_buckets[i] = std::move(new_buckets);
         }
         m_width = new_width;
+        if (m_config.adaptive_k) rebalance_kll_k();
+    }
+
+    // Moves the buckets onto the given rings as expand/shrink do, e.g. to replay a logged expand or shrink with its exact ring points
+    void remap(uint32_t new_width, std::span<const Ring> new_rings)
+    {
+        if (new_width == 0) throw std::invalid_argument("New width must be positive.");
+        if (new_rings.size() != m_depth) throw std::invalid_argument("Need one ring per row.");
+        for (uint32_t i = 0; i < m_depth; ++i)
+        {
+            Ring new_ring = new_rings[i];
+            for (auto &point : new_ring) { point.first = _quantize_point(point.first); }
+            std::vector<Bucket> new_buckets = _remap_row(m_rings[i], m_buckets[i], new_ring, new_width, m_kll_config);
+            m_rings[i] = std::move(new_ring);
+            m_buckets[i] = std::move(new_buckets);
+        }
+        m_width = new_width;
+        if (m_config.adaptive_k) rebalance_kll_k();
     }
 
     uint32_t get_max_memory_usage() const
@@ -151,41 +351,52 @@ public:
 
         // uint32_t rings_memory = m_depth * sizeof(Ring);
 
-        KLL sample_kll(m_kll_config);
+        Summary sample_kll(m_kll_config);
         uint32_t single_kll_max_memory = sample_kll.get_max_memory_usage();
 
-        return single_kll_max_memory * m_depth * m_width;
+        return single_kll_max_memory * m_depth * m_width + m_candidates.get_max_memory_usage() + m_distinct.get_max_memory_usage();
     }
 
     static uint32_t calculate_max_width(uint32_t total_memory_bytes, uint32_t depth, uint32_t kll_k)
     {
         if (depth == 0) return 0;
 
-        KLL sample_kll({kll_k});
+        Summary sample_kll({kll_k});
         uint32_t single_kll_max_memory = sample_kll.get_max_memory_usage();
 
         uint32_t max_buckets = total_memory_bytes / single_kll_max_memory;
         return static_cast<uint32_t>(max_buckets / depth);
     }
 
-    static ReSketchV2 merge(const ReSketchV2 &s1, const ReSketchV2 &s2)
+    // Largest width whose get_max_memory_usage() fits in total_memory_bytes, given this sketch's depth, kll_k and side structures
+    uint32_t calculate_max_width(uint32_t total_memory_bytes) const
+    {
+        uint32_t side_memory = m_candidates.get_max_memory_usage() + m_distinct.get_max_memory_usage();
+        if (total_memory_bytes <= side_memory) return 0;
+        return calculate_max_width(total_memory_bytes - side_memory, m_depth, m_kll_config.k);
+    }
+
+    static BasicReSketchV2 merge(const BasicReSketchV2 &s1, const BasicReSketchV2 &s2)
     {
         if (s1.m_depth != s2.m_depth || s1.m_kll_config.k != s2.m_kll_config.k) { throw std::invalid_argument("Sketches must have same depth and kll_k to merge."); }
 
         if (s1.m_seeds != s2.m_seeds) { throw std::invalid_argument("Sketches must have the same seeds to merge."); }
+        if (s1.m_config.invertible_partition_hash != s2.m_config.invertible_partition_hash) { throw std::invalid_argument("Sketches must use the same partition hash to merge."); }
+        if (s1.m_config.hll_precision != s2.m_config.hll_precision) { throw std::invalid_argument("Sketches must have the same hll_precision to merge."); }
 
         uint32_t new_width = s1.m_width + s2.m_width;
 
         // Merge rings: combine both rings and sort, reassigning bucket IDs
-        std::vector<Ring> merged_rings(s1.m_depth);
-        for (uint32_t i = 0; i < s1.m_depth; ++i) { merged_rings[i] = _merge_rings(s1.m_rings[i], s2.m_rings[i]); }
+        RowArray<Ring> merged_rings{};
+        _resize_rows(merged_rings, s1.m_depth);
+        for (uint32_t i = 0; i < s1.m_depth; ++i) { merged_rings[i] = _merge_rings(s1.m_rings[i], s2.m_rings[i], s1.m_width); }
 
-        ReSketchV2 merged_sketch(s1.m_depth, new_width, s1.m_seeds, s1.m_kll_config.k, s1.m_partition_seed, merged_rings);
+        BasicReSketchV2 merged_sketch(s1.m_depth, new_width, s1.m_seeds, s1.m_kll_config.k, s1.m_partition_seed, merged_rings);
 
         for (uint32_t i = 0; i < s1.m_depth; ++i)
         {
-            auto temp_buckets_1 = _remap_row(s1.m_rings[i], s1.m_buckets[i], merged_sketch.m_rings[i]);
-            auto temp_buckets_2 = _remap_row(s2.m_rings[i], s2.m_buckets[i], merged_sketch.m_rings[i]);
+            auto temp_buckets_1 = _remap_row(s1.m_rings[i], s1.m_buckets[i], merged_sketch.m_rings[i], new_width, s1.m_kll_config);
+            auto temp_buckets_2 = _remap_row(s2.m_rings[i], s2.m_buckets[i], merged_sketch.m_rings[i], new_width, s1.m_kll_config);
 
             for (uint32_t j = 0; j < new_width; ++j)
             {
@@ -200,23 +411,98 @@ public:
         merged_sketch.m_partition_ranges.insert(merged_sketch.m_partition_ranges.end(), s2.m_partition_ranges.begin(), s2.m_partition_ranges.end());
         _merge_and_sort_ranges(merged_sketch.m_partition_ranges);
 
+        merged_sketch._inherit_options(s1);
+        merged_sketch.m_candidates = SpaceSaving::merge(s1.m_candidates, s2.m_candidates);
+        merged_sketch.m_distinct = HyperLogLog::merge(s1.m_distinct, s2.m_distinct);
+        if (merged_sketch.m_config.adaptive_k) merged_sketch.rebalance_kll_k();
+
         return merged_sketch;
     }
 
+    // Bucket-wise merge of a sketch that shares this sketch's seeds and rings (e.g. a copy made before either was updated): no remapping needed
+    void merge_in_place(const BasicReSketchV2 &other)
+    {
+        if (m_seeds != other.m_seeds || m_partition_seed != other.m_partition_seed || m_rings != other.m_rings)
+        {
+            throw std::invalid_argument("merge_in_place needs sketches with the same seeds and rings.");
+        }
+        for (uint32_t i = 0; i < m_depth; ++i)
+        {
+            for (uint32_t j = 0; j < m_width; ++j)
+            {
+                m_buckets[i][j].count += other.m_buckets[i][j].count;
+                m_buckets[i][j].q_sketch.merge(other.m_buckets[i][j].q_sketch);
+            }
+        }
+        m_candidates = SpaceSaving::merge(m_candidates, other.m_candidates);
+        m_distinct.merge(other.m_distinct);
+    }
+
+    // Divides every weight in the sketch by 2^shift (used by time decay to renormalize). KLL levels at or above shift keep all their items
+    // with their weight shifted; lighter items survive with probability weight / 2^shift as weight 1, so the result stays unbiased.
+    void downscale(uint32_t shift)
+    {
+        if (shift == 0) return;
+        std::mt19937_64 rng(std::random_device{}());
+        const long double scale = std::ldexp(1.0L, -static_cast<int>(shift));
+        std::vector<std::pair<uint64_t, uint64_t>> weighted_items;
+        for (auto &row : m_buckets)
+        {
+            for (auto &bucket : row)
+            {
+                if (bucket.count == 0) continue;
+                weighted_items.clear();
+                uint64_t new_count = 0;
+                bucket.q_sketch.for_each_summarized_item(
+                    [&](uint64_t h, uint64_t weight)
+                    {
+                        uint64_t scaled = _round_randomly(static_cast<long double>(weight) * scale, rng);
+                        if (scaled == 0) return;
+                        weighted_items.emplace_back(h, scaled);
+                        new_count += scaled;
+                    });
+                bucket.count = new_count;
+                const KLLConfig config = bucket.q_sketch.get_config();
+                bucket.q_sketch = weighted_items.empty() ? Summary(config) : Summary::construct_from_weighted_items(weighted_items, config);
+            }
+        }
+        m_candidates.downscale(shift);
+        // Distinct counts do not decay: the HyperLogLog is left as is
+    }
+
+    // Drops every count but keeps seeds, rings and partition ranges, so the sketch can be reused; bucket summaries are rebuilt empty
+    void reset()
+    {
+        for (auto &row : m_buckets)
+        {
+            for (auto &bucket : row)
+            {
+                bucket.count = 0;
+                bucket.q_sketch = Summary(bucket.q_sketch.get_config());
+            }
+        }
+        m_candidates.clear();
+        m_distinct.clear();
+    }
+
     // Original merge function that creates new random rings
-    static ReSketchV2 merge_with_new_rings(const ReSketchV2 &s1, const ReSketchV2 &s2)
+    static BasicReSketchV2 merge_with_new_rings(const BasicReSketchV2 &s1, const BasicReSketchV2 &s2)
     {
         if (s1.m_depth != s2.m_depth || s1.m_kll_config.k != s2.m_kll_config.k) { throw std::invalid_argument("Sketches must have same depth and kll_k to merge."); }
 
         if (s1.m_seeds != s2.m_seeds) { throw std::invalid_argument("Sketches must have the same seeds to merge."); }
+        if (s1.m_config.invertible_partition_hash != s2.m_config.invertible_partition_hash) { throw std::invalid_argument("Sketches must use the same partition hash to merge."); }
+        if (s1.m_config.hll_precision != s2.m_config.hll_precision) { throw std::invalid_argument("Sketches must have the same hll_precision to merge."); }
 
         uint32_t new_width = s1.m_width + s2.m_width;
-        ReSketchV2 merged_sketch(s1.m_depth, new_width, s1.m_seeds, s1.m_kll_config.k, s1.m_partition_seed);
+        BasicReSketchV2 merged_sketch(s1.m_depth, new_width, s1.m_seeds, s1.m_kll_config.k, s1.m_partition_seed);
+        merged_sketch._inherit_options(s1);
+        merged_sketch._initialize_rings();   // with s1's virtual nodes
 
         for (uint32_t i = 0; i < s1.m_depth; ++i)
         {
-            auto temp_buckets_1 = _remap_row(s1.m_rings[i], s1.m_buckets[i], merged_sketch.m_rings[i]);
-            auto temp_buckets_2 = _remap_row(s2.m_rings[i], s2.m_buckets[i], merged_sketch.m_rings[i]);
+            auto temp_buckets_1 = _remap_row(s1.m_rings[i], s1.m_buckets[i], merged_sketch.m_rings[i], new_width, s1.m_kll_config);
+            auto temp_buckets_2 = _remap_row(s2.m_rings[i], s2.m_buckets[i], merged_sketch.m_rings[i], new_width, s1.m_kll_config);
 
             for (uint32_t j = 0; j < new_width; ++j)
             {
@@ -231,17 +517,352 @@ public:
         merged_sketch.m_partition_ranges.insert(merged_sketch.m_partition_ranges.end(), s2.m_partition_ranges.begin(), s2.m_partition_ranges.end());
         _merge_and_sort_ranges(merged_sketch.m_partition_ranges);
 
+        merged_sketch._inherit_options(s1);
+        merged_sketch.m_candidates = SpaceSaving::merge(s1.m_candidates, s2.m_candidates);
+        merged_sketch.m_distinct = HyperLogLog::merge(s1.m_distinct, s2.m_distinct);
+        if (merged_sketch.m_config.adaptive_k) merged_sketch.rebalance_kll_k();
+
         return merged_sketch;
     }
 
-    static std::pair<ReSketchV2, ReSketchV2> split(const ReSketchV2 &sketch, uint32_t width_1, uint32_t width_2)
+    static std::pair<BasicReSketchV2, BasicReSketchV2> split(const BasicReSketchV2 &sketch, uint32_t width_1, uint32_t width_2)
+    {
+        if (width_1 + width_2 != sketch.m_width) { throw std::invalid_argument("Split widths must sum to original width."); }
+
+        BasicReSketchV2 s1(sketch.m_depth, width_1, sketch.m_seeds, sketch.m_kll_config.k, sketch.m_partition_seed);
+        BasicReSketchV2 s2(sketch.m_depth, width_2, sketch.m_seeds, sketch.m_kll_config.k, sketch.m_partition_seed);
+        for (auto *part : {&s1, &s2})
+        {
+            part->_inherit_options(sketch);
+            part->_initialize_rings();   // with the source's virtual nodes
+        }
+        return _split_into(sketch, std::move(s1), std::move(s2));
+    }
+
+    // Split onto given rings for the two parts, e.g. to replay a logged split exactly
+    static std::pair<BasicReSketchV2, BasicReSketchV2>
+    split(const BasicReSketchV2 &sketch, uint32_t width_1, uint32_t width_2, std::span<const Ring> rings_1, std::span<const Ring> rings_2)
     {
         if (width_1 + width_2 != sketch.m_width) { throw std::invalid_argument("Split widths must sum to original width."); }
+        if (rings_1.size() != sketch.m_depth || rings_2.size() != sketch.m_depth) { throw std::invalid_argument("Need one ring per row for each part."); }
+
+        BasicReSketchV2 s1(sketch.m_depth, width_1, sketch.m_seeds, sketch.m_kll_config.k, sketch.m_partition_seed, rings_1);
+        BasicReSketchV2 s2(sketch.m_depth, width_2, sketch.m_seeds, sketch.m_kll_config.k, sketch.m_partition_seed, rings_2);
+        s1._inherit_options(sketch);
+        s2._inherit_options(sketch);
+        return _split_into(sketch, std::move(s1), std::move(s2));
+    }
+
+    // --- Serialization ---
+
+    // Seeds, rings, partition ranges, side structures and every bucket's count and summarized items. A bucket summary is rebuilt from its
+    // items on load, so estimates survive a round trip while the summary's internal compaction state may differ.
+    void serialize(std::ostream &os) const
+    {
+        binary_stream::write<uint32_t>(os, serial_magic);
+        binary_stream::write<uint32_t>(os, serial_version);
+        binary_stream::write<uint32_t>(os, summary_hash_bits<Summary>);
+        binary_stream::write<uint32_t>(os, m_width);
+        binary_stream::write<uint32_t>(os, m_depth);
+        binary_stream::write<uint32_t>(os, m_kll_config.k);
+        binary_stream::write<uint8_t>(os, m_config.adaptive_k);
+        binary_stream::write<uint32_t>(os, m_config.top_k_candidates);
+        binary_stream::write<uint8_t>(os, m_config.invertible_partition_hash);
+        binary_stream::write<uint32_t>(os, m_config.hll_precision);
+        binary_stream::write<uint8_t>(os, m_config.load_aware_resize);
+        binary_stream::write<uint32_t>(os, m_config.virtual_nodes);
+        binary_stream::write<uint32_t>(os, m_partition_seed);
+        binary_stream::write_vector(os, std::vector<uint32_t>(m_seeds.begin(), m_seeds.end()));
+        binary_stream::write_vector(os, m_partition_ranges);
+        for (const auto &ring : m_rings) binary_stream::write_vector(os, ring);
+
+        std::vector<std::pair<uint64_t, uint64_t>> weighted_items;
+        for (const auto &row : m_buckets)
+        {
+            for (const auto &bucket : row)
+            {
+                weighted_items.clear();
+                bucket.q_sketch.for_each_summarized_item([&](uint64_t h, uint64_t weight) { weighted_items.emplace_back(h, weight); });
+                binary_stream::write<uint64_t>(os, bucket.count);
+                binary_stream::write<uint32_t>(os, bucket.q_sketch.get_config().k);
+                binary_stream::write_vector(os, weighted_items);
+            }
+        }
+        m_candidates.serialize(os);
+        m_distinct.serialize(os);
+    }
+
+    static BasicReSketchV2 deserialize(std::istream &is)
+    {
+        if (binary_stream::read<uint32_t>(is) != serial_magic) { throw std::runtime_error("Not a serialized ReSketchV2."); }
+        if (binary_stream::read<uint32_t>(is) != serial_version) { throw std::runtime_error("Unsupported ReSketchV2 format version."); }
+        if (binary_stream::read<uint32_t>(is) != summary_hash_bits<Summary>) { throw std::runtime_error("Serialized ReSketchV2 uses another bucket hash width."); }
+
+        ReSketchConfig config;
+        config.width = binary_stream::read<uint32_t>(is);
+        config.depth = binary_stream::read<uint32_t>(is);
+        config.kll_k = binary_stream::read<uint32_t>(is);
+        config.adaptive_k = binary_stream::read<uint8_t>(is) != 0;
+        config.top_k_candidates = binary_stream::read<uint32_t>(is);
+        config.invertible_partition_hash = binary_stream::read<uint8_t>(is) != 0;
+        config.hll_precision = binary_stream::read<uint32_t>(is);
+        config.load_aware_resize = binary_stream::read<uint8_t>(is) != 0;
+        config.virtual_nodes = binary_stream::read<uint32_t>(is);
+        uint32_t partition_seed = binary_stream::read<uint32_t>(is);
+        std::vector<uint32_t> seeds = binary_stream::read_vector<uint32_t>(is);
+        auto partition_ranges = binary_stream::read_vector<std::pair<uint64_t, uint64_t>>(is);
+        if (seeds.size() != config.depth) { throw std::runtime_error("Serialized ReSketchV2 has a seed count other than its depth."); }
+        std::vector<Ring> rings(config.depth);
+        for (auto &ring : rings)
+        {
+            ring = binary_stream::read_vector<std::pair<uint64_t, uint32_t>>(is);
+            for (const auto &point : ring)
+            {
+                if (point.second >= config.width) { throw std::runtime_error("Serialized ReSketchV2 ring refers to a bucket beyond its width."); }
+            }
+        }
+
+        BasicReSketchV2 sketch(config.depth, config.width, seeds, config.kll_k, partition_seed, rings);
+        sketch.m_config = config;
+        sketch.m_partition_ranges = std::move(partition_ranges);
+        for (auto &row : sketch.m_buckets)
+        {
+            for (auto &bucket : row)
+            {
+                bucket.count = binary_stream::read<uint64_t>(is);
+                KLLConfig bucket_config{binary_stream::read<uint32_t>(is)};
+                auto weighted_items = binary_stream::read_vector<std::pair<uint64_t, uint64_t>>(is);
+                bucket.q_sketch = weighted_items.empty() ? Summary(bucket_config) : Summary::construct_from_weighted_items(weighted_items, bucket_config);
+            }
+        }
+        sketch.m_candidates = SpaceSaving::deserialize(is);
+        sketch.m_distinct = HyperLogLog::deserialize(is);
+        return sketch;
+    }
+
+    // --- Heavy hitters ---
+
+    // Up to k candidates from the Space-Saving table (config top_k_candidates), ranked by the sketch's estimate, highest first.
+    // The table survives expand/shrink, is merged with the Space-Saving merge rule and filtered by partition on split.
+    std::vector<std::pair<uint64_t, double>> top_k(uint32_t k) const
+    {
+        std::vector<std::pair<uint64_t, double>> ranked;
+        ranked.reserve(m_candidates.get_counters().size());
+        for (const auto &counter : m_candidates.get_counters()) { ranked.emplace_back(counter.item, estimate(counter.item)); }
+        std::sort(
+            ranked.begin(), ranked.end(),
+            [](const auto &a, const auto &b)
+            {
+                return a.second > b.second;
+            });
+        if (ranked.size() > k) ranked.resize(k);
+        return ranked;
+    }
+
+    const SpaceSaving &get_candidates() const { return m_candidates; }
+
+    // Items whose estimate reaches threshold, decoded straight from the retained KLL items (needs invertible_partition_hash, 64-bit buckets).
+    // Both hash steps are inverted: placement -> partition hash via a_inv, partition hash -> item via InvertibleMix64. Any retained hash
+    // whose weight within one bucket reaches threshold / 2 becomes a candidate, which is then checked against the median estimate.
+    std::vector<std::pair<uint64_t, double>> heavy_hitters(double threshold) const
+    {
+        if (!m_config.invertible_partition_hash) { throw std::logic_error("heavy_hitters needs the invertible partition hash."); }
+        if constexpr (is_compact) { throw std::logic_error("heavy_hitters cannot decode items from 32-bit fingerprints."); }
+
+        std::set<uint64_t> candidates;
+        std::map<uint64_t, double> bucket_weights;
+        for (uint32_t i = 0; i < m_depth; ++i)
+        {
+            for (const auto &bucket : m_buckets[i])
+            {
+                if (static_cast<double>(bucket.count) < threshold / 2) continue;
+                bucket_weights.clear();
+                bucket.q_sketch.for_each_summarized_item([&](uint64_t h, uint64_t weight) { bucket_weights[h] += static_cast<double>(weight); });
+                for (const auto &[h, weight] : bucket_weights)
+                {
+                    if (weight >= threshold / 2) candidates.insert(InvertibleMix64::invert(_recover_partition_hash(h, i), m_partition_seed));
+                }
+            }
+        }
+
+        std::vector<std::pair<uint64_t, double>> result;
+        for (uint64_t item : candidates)
+        {
+            double estimated_count = estimate(item);
+            if (estimated_count >= threshold && is_responsible_for(item)) result.emplace_back(item, estimated_count);
+        }
+        std::sort(
+            result.begin(), result.end(),
+            [](const auto &a, const auto &b)
+            {
+                return a.second > b.second;
+            });
+        return result;
+    }
+
+    // --- Distinct items ---
+
+    // Estimated number of distinct items in this sketch's partition ranges (needs hll_precision), e.g. to pick a width with
+    // calculate_max_width or to decide on expand/shrink online. The HyperLogLog is fed the partition hash that update computes anyway.
+    double estimate_distinct() const
+    {
+        if (!m_distinct.is_enabled()) { throw std::logic_error("estimate_distinct needs hll_precision > 0."); }
+        return m_distinct.estimate(m_partition_ranges);
+    }
+
+    // --- Adaptive per-bucket k ---
+
+    // Redistributes each row's k budget (width * kll_k) across its buckets in proportion to their mass, clamped to [min_adaptive_k, max_adaptive_k].
+    // Memory is linear in k, so the sketch stays within get_max_memory_usage(); hot buckets gain accuracy at the expense of cold ones.
+    // Called after every structural operation when the config enables adaptive_k, and may be called at any time (e.g. periodically).
+    void rebalance_kll_k()
+    {
+        if constexpr (!summary_supports_variable_k<Summary>) { throw std::logic_error("Adaptive k needs a bucket summary whose k is not fixed at compile time."); }
+        else
+        {
+            for (uint32_t i = 0; i < m_depth; ++i) { _rebalance_row(m_buckets[i]); }
+        }
+    }
+
+    uint32_t get_bucket_k(uint32_t row, uint32_t bucket_id) const { return m_buckets[row][bucket_id].q_sketch.get_config().k; }
+
+    // Static method to compute partition hash without needing a sketch instance
+    static uint64_t compute_partition_hash(uint64_t item, uint32_t partition_seed, bool invertible = false)
+    {
+        if (invertible) return InvertibleMix64::hash(item, partition_seed);
+        return XXHash64::hash(&item, sizeof(uint64_t), partition_seed);
+    }
+
+    // Check if this sketch is responsible for a given item based on partition ranges
+    bool is_responsible_for(uint64_t item) const
+    {
+        uint64_t h = _partition_hash(item);
+        for (const auto &[start, end] : m_partition_ranges)
+        {
+            if (h >= start && h < end) return true;
+        }
+        return false;
+    }
+
+    // Get the partition seed (needed for distributed systems to compute partition hash)
+    uint32_t get_partition_seed() const { return m_partition_seed; }
+
+    // Get the partition ranges this sketch is responsible for
+    const std::vector<std::pair<uint64_t, uint64_t>> &get_partition_ranges() const { return m_partition_ranges; }
+
+    uint32_t get_width() const { return m_width; }
+    uint32_t get_depth() const { return m_depth; }
+    const ReSketchConfig &get_config() const { return m_config; }
+    uint64_t get_bucket_count(uint32_t row, uint32_t bucket_id) const { return m_buckets[row][bucket_id].count; }
+    std::span<const Ring> get_rings() const { return m_rings; }
+    std::span<const uint32_t> get_seeds() const { return m_seeds; }
+    // (a, b) of the row's placement hash a * partition_hash + b
+    std::pair<uint64_t, uint64_t> get_row_hash_parameters(uint32_t row) const { return {m_a[row], m_b[row]}; }
+    // Bucket owning a placement hash: the first ring point at or after it, wrapping around
+    static uint32_t find_bucket_id(uint64_t placement_hash, const Ring &ring) { return _find_bucket_id(placement_hash, ring); }
+
+    // Bucket-level access for external encoders such as ReSketchEpochStore: func(row, bucket_id, count, summary) for every bucket
+    template <typename Func> void for_each_bucket(Func &&func) const
+    {
+        for (uint32_t i = 0; i < m_depth; ++i)
+        {
+            for (uint32_t j = 0; j < m_width; ++j) func(i, j, m_buckets[i][j].count, m_buckets[i][j].q_sketch);
+        }
+    }
+
+    // Adds a bucket's count and summary; on a reset sketch this restores the bucket
+    void merge_into_bucket(uint32_t row, uint32_t bucket_id, uint64_t count, const Summary &summary)
+    {
+        Bucket &bucket = m_buckets[row][bucket_id];
+        if (bucket.count == 0) bucket.q_sketch = summary;
+        else
+        {
+            bucket.q_sketch.merge(summary);
+        }
+        bucket.count += count;
+    }
 
-        ReSketchV2 s1(sketch.m_depth, width_1, sketch.m_seeds, sketch.m_kll_config.k, sketch.m_partition_seed);
-        ReSketchV2 s2(sketch.m_depth, width_2, sketch.m_seeds, sketch.m_kll_config.k, sketch.m_partition_seed);
+    const HyperLogLog &get_distinct_sketch() const { return m_distinct; }
+
+    void merge_side_structures(const SpaceSaving &candidates, const HyperLogLog &distinct)
+    {
+        m_candidates = SpaceSaving::merge(m_candidates, candidates);
+        m_distinct.merge(distinct);
+    }
+
+private:
+    // floor(x) plus one with probability frac(x): an unbiased integer rounding
+    static uint64_t _round_randomly(long double x, std::mt19937_64 &rng)
+    {
+        long double whole = std::floor(x);
+        long double frac = x - whole;
+        uint64_t rounded = static_cast<uint64_t>(whole);
+        if (frac > 0 && std::uniform_real_distribution<long double>(0.0L, 1.0L)(rng) < frac) ++rounded;
+        return rounded;
+    }
+
+    // Compute modular multiplicative inverse using extended Euclidean algorithm
+    // For odd 'a', there exists a_inv such that a * a_inv ≡ 1 (mod 2^64)
+    static uint64_t _mod_inverse(uint64_t a)
+    {
+        // Using the fact that for odd a: a * a_inv ≡ 1 (mod 2^64)
+        // We can use extended GCD or Newton's method
+        // Newton's method: x_{n+1} = x_n * (2 - a * x_n)
+        uint64_t x = a;        // Initial approximation
+        x = x * (2 - a * x);   // mod 2^2
+        x = x * (2 - a * x);   // mod 2^4
+        x = x * (2 - a * x);   // mod 2^8
+        x = x * (2 - a * x);   // mod 2^16
+        x = x * (2 - a * x);   // mod 2^32
+        x = x * (2 - a * x);   // mod 2^64
+        return x;
+    }
+
+    // Helper function to print KLL details by level
+    static void _print_kll_details(const std::string &label, uint32_t bucket_id, const Summary &kll)
+    {
+        // Only the for_each_summarized_item part is in the BucketSummary concept
+        std::cout << label << " Bucket " << bucket_id;
+        if constexpr (requires { kll.get_n(), kll.get_num_retained(), kll.get_num_levels(); })
+        {
+            std::cout << ": n=" << kll.get_n() << ", num_retained=" << kll.get_num_retained() << ", num_levels=" << static_cast<int>(kll.get_num_levels());
+        }
+        std::cout << std::endl;
+
+        std::map<uint8_t, std::vector<uint64_t>> items_by_level;
+        kll.for_each_summarized_item(
+            [&](uint64_t item, uint64_t weight)
+            {
+                uint8_t level = 0;
+                uint64_t w = weight;
+                while (w > 1)
+                {
+                    w >>= 1;
+                    ++level;
+                }
+                items_by_level[level].push_back(item);
+            });
+
+        for (const auto &[level, items] : items_by_level)
+        {
+            std::cout << "    Level " << static_cast<int>(level) << " (weight=" << (1ULL << level) << "): ";
+            for (size_t i = 0; i < items.size(); ++i)
+            {
+                std::cout << items[i];
+                if (i < items.size() - 1) std::cout << ", ";
+            }
+            std::cout << std::endl;
+        }
+    }
 
+    // Moves the source's items into the two parts, which already have their rings, and splits ranges and side structures at the split point
+    static std::pair<BasicReSketchV2, BasicReSketchV2> _split_into(const BasicReSketchV2 &sketch, BasicReSketchV2 s1, BasicReSketchV2 s2)
+    {
+        uint32_t width_1 = s1.m_width;
+        uint32_t width_2 = s2.m_width;
         uint64_t split_point = static_cast<uint64_t>((static_cast<long double>(width_1) / (width_1 + width_2)) * std::numeric_limits<uint64_t>::max());
+        // Only the upper 32 bits of the partition hash survive in compact mode, so the split must fall on a 2^32 boundary
+        if constexpr (is_compact) { split_point &= ~low_mask; }
 
         // Process each row
         for (uint32_t row = 0; row < sketch.m_depth; ++row)
@@ -290,11 +911,11 @@ public:
             // Step 3: Construct new KLLs from the partitioned items
             for (auto &[bucket_id, weighted_items] : s1_bucket_items)
             {
-                if (!weighted_items.empty()) { s1.m_buckets[row][bucket_id].q_sketch = KLL::construct_from_weighted_items(weighted_items, sketch.m_kll_config); }
+                if (!weighted_items.empty()) { s1.m_buckets[row][bucket_id].q_sketch = Summary::construct_from_weighted_items(weighted_items, sketch.m_kll_config); }
             }
             for (auto &[bucket_id, weighted_items] : s2_bucket_items)
             {
-                if (!weighted_items.empty()) { s2.m_buckets[row][bucket_id].q_sketch = KLL::construct_from_weighted_items(weighted_items, sketch.m_kll_config); }
+                if (!weighted_items.empty()) { s2.m_buckets[row][bucket_id].q_sketch = Summary::construct_from_weighted_items(weighted_items, sketch.m_kll_config); }
             }
 
             // Print new KLLs after split
@@ -317,124 +938,108 @@ public:
             if (end > split_point) { s2.m_partition_ranges.push_back({std::max(start, split_point), end}); }
         }
 
+        for (auto *part : {&s1, &s2})
+        {
+            part->_inherit_options(sketch);
+            part->m_candidates = sketch.m_candidates.filter([&](uint64_t item) { return part->is_responsible_for(item); });
+            part->m_distinct = sketch.m_distinct;
+            part->m_distinct.retain_ranges(part->m_partition_ranges);
+            if (part->m_config.adaptive_k) part->rebalance_kll_k();
+        }
+
         return {std::move(s1), std::move(s2)};
     }
 
-    // Static method to compute partition hash without needing a sketch instance
-    static uint64_t compute_partition_hash(uint64_t item, uint32_t partition_seed) { return XXHash64::hash(&item, sizeof(uint64_t), partition_seed); }
-
-    // Check if this sketch is responsible for a given item based on partition ranges
-    bool is_responsible_for(uint64_t item) const
+    // Sketches built by merge/split take over the optional features of their source
+    void _inherit_options(const BasicReSketchV2 &source)
     {
-        uint64_t h = _partition_hash(item);
-        for (const auto &[start, end] : m_partition_ranges)
-        {
-            if (h >= start && h < end) return true;
-        }
-        return false;
+        m_config.adaptive_k = source.m_config.adaptive_k;
+        m_config.top_k_candidates = source.m_config.top_k_candidates;
+        m_config.invertible_partition_hash = source.m_config.invertible_partition_hash;
+        m_config.hll_precision = source.m_config.hll_precision;
+        m_config.load_aware_resize = source.m_config.load_aware_resize;
+        m_config.virtual_nodes = source.m_config.virtual_nodes;
     }
 
-    // Get the partition seed (needed for distributed systems to compute partition hash)
-    uint32_t get_partition_seed() const { return m_partition_seed; }
-
-    // Get the partition ranges this sketch is responsible for
-    const std::vector<std::pair<uint64_t, uint64_t>> &get_partition_ranges() const { return m_partition_ranges; }
+    // Ring points per bucket; 0 in a config is treated as 1
+    uint32_t _virtual_nodes() const { return std::max(m_config.virtual_nodes, 1u); }
 
-private:
-    // Compute modular multiplicative inverse using extended Euclidean algorithm
-    // For odd 'a', there exists a_inv such that a * a_inv ≡ 1 (mod 2^64)
-    static uint64_t _mod_inverse(uint64_t a)
+    // Runs before any bucket or ring is built: an empty row has nowhere to place an item, and the summary rejects a k outside its own range
+    void _check_config() const
     {
-        // Using the fact that for odd a: a * a_inv ≡ 1 (mod 2^64)
-        // We can use extended GCD or Newton's method
-        // Newton's method: x_{n+1} = x_n * (2 - a * x_n)
-        uint64_t x = a;        // Initial approximation
-        x = x * (2 - a * x);   // mod 2^2
-        x = x * (2 - a * x);   // mod 2^4
-        x = x * (2 - a * x);   // mod 2^8
-        x = x * (2 - a * x);   // mod 2^16
-        x = x * (2 - a * x);   // mod 2^32
-        x = x * (2 - a * x);   // mod 2^64
-        return x;
+        if (m_width == 0 || m_depth == 0) { throw std::invalid_argument("ReSketch width and depth must be positive."); }
+        if (m_kll_config.k == 0) { throw std::invalid_argument("ReSketch kll_k must be positive."); }
+        static_cast<void>(Summary(m_kll_config));
+        if (is_fixed_depth && m_depth != Depth) { throw std::invalid_argument("Depth does not match the compile-time depth of this sketch."); }
+        if (m_config.adaptive_k && !summary_supports_variable_k<Summary>) { throw std::invalid_argument("Adaptive k needs a bucket summary whose k is not fixed at compile time."); }
     }
 
-    // Helper function to print KLL details by level
-    static void _print_kll_details(const std::string &label, uint32_t bucket_id, const KLL &kll)
+    // Applies func(row) to every row; with a compile-time depth the loop is fully unrolled
+    template <typename Func> void _for_each_row(Func &&func) const
     {
-        std::cout << label << " Bucket " << bucket_id << ": n=" << kll.get_n() << ", num_retained=" << kll.get_num_retained()
-                  << ", num_levels=" << static_cast<int>(kll.get_num_levels()) << std::endl;
-
-        std::map<uint8_t, std::vector<uint64_t>> items_by_level;
-        kll.for_each_summarized_item(
-            [&](uint64_t item, uint64_t weight)
+        if constexpr (is_fixed_depth)
+        {
+            [&]<uint32_t... I>(std::integer_sequence<uint32_t, I...>)
             {
-                uint8_t level = 0;
-                uint64_t w = weight;
-                while (w > 1)
-                {
-                    w >>= 1;
-                    ++level;
-                }
-                items_by_level[level].push_back(item);
-            });
+                (func(I), ...);
+            }(std::make_integer_sequence<uint32_t, Depth>{});
+        }
+        else
+        {
+            for (uint32_t i = 0; i < m_depth; ++i) { func(i); }
+        }
+    }
 
-        for (const auto &[level, items] : items_by_level)
+    template <typename Rows> static void _resize_rows(Rows &rows, uint32_t depth)
+    {
+        if constexpr (!is_fixed_depth) { rows.resize(depth); }
+    }
+
+    template <typename T> static RowArray<T> _to_rows(std::span<const T> values)
+    {
+        RowArray<T> rows{};
+        if constexpr (is_fixed_depth)
         {
-            std::cout << "    Level " << static_cast<int>(level) << " (weight=" << (1ULL << level) << "): ";
-            for (size_t i = 0; i < items.size(); ++i)
-            {
-                std::cout << items[i];
-                if (i < items.size() - 1) std::cout << ", ";
-            }
-            std::cout << std::endl;
+            if (values.size() != Depth) { throw std::invalid_argument("Expected one value per row of the compile-time depth."); }
+            std::copy(values.begin(), values.end(), rows.begin());
+        }
+        else
+        {
+            rows.assign(values.begin(), values.end());
         }
+        return rows;
     }
 
     void _initialize_seeds()
     {
         std::mt19937_64 rng(std::random_device{}());
         std::uniform_int_distribution<uint32_t> seed_dist;
-        std::uniform_int_distribution<uint64_t> param_dist;
 
         m_partition_seed = seed_dist(rng);
-        m_seeds.reserve(m_depth);
-        m_a.reserve(m_depth);
-        m_b.reserve(m_depth);
-        m_a_inv.reserve(m_depth);
-
-        for (uint32_t i = 0; i < m_depth; ++i) { m_seeds.push_back(seed_dist(rng)); }
-
-        std::mt19937_64 param_rng(m_partition_seed);
-        for (uint32_t i = 0; i < m_depth; ++i)
-        {
-            param_rng.seed(m_seeds[i]);
-            uint64_t a = param_dist(param_rng) | 1;
-            m_a.push_back(a);
-            m_a_inv.push_back(_mod_inverse(a));
-            m_b.push_back(param_dist(param_rng));
-        }
+        _resize_rows(m_seeds, m_depth);
+        for (uint32_t i = 0; i < m_depth; ++i) { m_seeds[i] = seed_dist(rng); }
     }
 
     void _initialize_pairwise_hash_family()
     {
         std::mt19937_64 rng(m_partition_seed);
         std::uniform_int_distribution<uint64_t> param_dist;
-        m_a.reserve(m_depth);
-        m_b.reserve(m_depth);
-        m_a_inv.reserve(m_depth);
+        _resize_rows(m_a, m_depth);
+        _resize_rows(m_b, m_depth);
+        _resize_rows(m_a_inv, m_depth);
         for (uint32_t i = 0; i < m_depth; ++i)
         {
             rng.seed(m_seeds[i]);
             uint64_t a = param_dist(rng) | 1;
-            m_a.push_back(a);
-            m_a_inv.push_back(_mod_inverse(a));
-            m_b.push_back(param_dist(rng));
+            m_a[i] = a;
+            m_a_inv[i] = _mod_inverse(a);
+            m_b[i] = param_dist(rng);
         }
     }
 
     void _initialize_buckets()
     {
-        m_buckets.resize(m_depth);
+        _resize_rows(m_buckets, m_depth);
         for (uint32_t i = 0; i < m_depth; ++i)
         {
             m_buckets[i].reserve(m_width);
@@ -446,29 +1051,63 @@ private:
     {
         std::mt19937_64 rng(std::random_device{}());
         std::uniform_int_distribution<uint64_t> dist;
-        m_rings.resize(m_depth);
+        _resize_rows(m_rings, m_depth);
         for (uint32_t i = 0; i < m_depth; ++i)
         {
-            m_rings[i].reserve(m_width);
-            for (uint32_t j = 0; j < m_width; ++j) { m_rings[i].push_back({dist(rng), j}); }
+            m_rings[i].clear();
+            m_rings[i].reserve(m_width * _virtual_nodes());
+            for (uint32_t j = 0; j < m_width; ++j)
+            {
+                for (uint32_t v = 0; v < _virtual_nodes(); ++v) { m_rings[i].push_back({_quantize_point(dist(rng)), j}); }
+            }
             std::sort(m_rings[i].begin(), m_rings[i].end());
         }
     }
 
     // Step 1: Hash item to a partition space. This hash is consistent for a given item.
-    uint64_t _partition_hash(uint64_t item) const { return XXHash64::hash(&item, sizeof(uint64_t), m_partition_seed); }
+    uint64_t _partition_hash(uint64_t item) const { return compute_partition_hash(item, m_partition_seed, m_config.invertible_partition_hash); }
 
     // Step 2: Create a reversible placement hash
-    uint64_t _placement_hash(uint64_t item, uint32_t row_index) const
+    uint64_t _placement_hash(uint64_t item, uint32_t row_index) const { return _placement_hash_from_partition(_partition_hash(item), row_index); }
+
+    // The partition hash is computed once per item and shared by all rows.
+    // In compact mode the pairwise hash works mod 2^32 on the upper half of the partition hash (still invertible as 'a' is odd),
+    // and the result is stored as (fingerprint << 32) | 0xFFFFFFFF, the representative CompactKLL hands back.
+    uint64_t _placement_hash_from_partition(uint64_t partition_h, uint32_t row_index) const
     {
-        uint64_t partition_h = _partition_hash(item);
+        if constexpr (is_compact)
+        {
+            uint32_t fingerprint = static_cast<uint32_t>(m_a[row_index]) * static_cast<uint32_t>(partition_h >> 32) + static_cast<uint32_t>(m_b[row_index]);
+            return (static_cast<uint64_t>(fingerprint) << 32) | low_mask;
+        }
         return m_a[row_index] * partition_h + m_b[row_index];
     }
 
+    // Ring points are aligned to 2^32 in compact mode: arc boundaries then fall between fingerprints and never coincide with a placement hash
+    static uint64_t _quantize_point(uint64_t point)
+    {
+        if constexpr (is_compact) { return point & ~low_mask; }
+        return point;
+    }
+
+    double _row_estimate(uint64_t partition_h, uint32_t row_index) const
+    {
+        uint64_t h = _placement_hash_from_partition(partition_h, row_index);
+        uint32_t id = _find_bucket_id(h, m_rings[row_index]);
+        return m_buckets[row_index][id].q_sketch.estimate(h);
+    }
+
     // Reverses Step 2 to recover the partition hash using modular multiplicative inverse.
     uint64_t _recover_partition_hash(uint64_t placement_hash, uint32_t row_index) const
     {
         // placement_hash = a * partition_hash + b (mod 2^64) -> partition_hash = (placement_hash - b) * a_inv (mod 2^64)
+        if constexpr (is_compact)
+        {
+            // Only the upper 32 bits of the partition hash are recoverable
+            uint32_t fingerprint = static_cast<uint32_t>(placement_hash >> 32);
+            uint32_t partition_hi = (fingerprint - static_cast<uint32_t>(m_b[row_index])) * static_cast<uint32_t>(m_a_inv[row_index]);
+            return static_cast<uint64_t>(partition_hi) << 32;
+        }
         return (placement_hash - m_b[row_index]) * m_a_inv[row_index];
     }
 
@@ -482,17 +1121,17 @@ private:
         return it->second;
     }
 
-    static std::vector<Bucket> _remap_row(const Ring &in_ring, const std::vector<Bucket> &in_buckets, const Ring &out_ring)
+    // Output buckets start at kll_config; input buckets may carry other k values (adaptive k), so the merges below can be cross-k
+    static std::vector<Bucket> _remap_row(const Ring &in_ring, const std::vector<Bucket> &in_buckets, const Ring &out_ring, uint32_t out_width, const KLLConfig &kll_config)
     {
         std::vector<Bucket> out_buckets;
         if (in_buckets.empty())
         {
-            out_buckets.resize(out_ring.size());
+            out_buckets.resize(out_width);
             return out_buckets;
         }
 
-        const auto &kll_config = in_buckets[0].q_sketch.get_config();
-        for (uint32_t i = 0; i < out_ring.size(); ++i) { out_buckets.emplace_back(kll_config); }
+        for (uint32_t i = 0; i < out_width; ++i) { out_buckets.emplace_back(kll_config); }
 
         std::set<uint64_t> point_set;
         for (const auto &p : in_ring) point_set.insert(p.first);
@@ -519,35 +1158,234 @@ private:
             // std::cout << std::endl;
 
             const auto &in_bucket = in_buckets[in_id];
-            double count = in_bucket.q_sketch.get_count_in_range(start_p, end_p);
+            // Nothing to move out of an empty bucket; keeps lazily materialized output buckets empty
+            if (in_bucket.count == 0)
+            {
+                prev_p = current_p;
+                continue;
+            }
+            auto move_range = [&](uint64_t range_start, uint64_t range_end)
+            {
+                double count = in_bucket.q_sketch.get_count_in_range(range_start, range_end);
 
-            // cout k of in bucket and out bucket
-            // std::cout << "In Bucket k: " << in_bucket.q_sketch.get_config().k << ", Out Bucket k: " << out_buckets[out_id].q_sketch.get_config().k << std::endl;
+                // cout k of in bucket and out bucket
+                // std::cout << "In Bucket k: " << in_bucket.q_sketch.get_config().k << ", Out Bucket k: " << out_buckets[out_id].q_sketch.get_config().k << std::endl;
 
-            if (count > 0)
+                if (count > 0)
+                {
+                    out_buckets[out_id].count += static_cast<uint64_t>(std::round(count));
+                    auto sub_sketch = in_bucket.q_sketch.rebuild(range_start, range_end);
+                    out_buckets[out_id].q_sketch.merge(sub_sketch);
+                }
+            };
+            // The range from the last point to the first wraps around the ring; the summaries only take ascending ranges
+            if (start_p < end_p) { move_range(start_p, end_p); }
+            else
             {
-                out_buckets[out_id].count += static_cast<uint64_t>(std::round(count));
-                auto sub_sketch = in_bucket.q_sketch.rebuild(start_p, end_p);
-                out_buckets[out_id].q_sketch.merge(sub_sketch);
+                move_range(start_p, std::numeric_limits<uint64_t>::max());
+                move_range(0, end_p);
             }
             prev_p = current_p;
         }
         return out_buckets;
     }
 
-    // Helper to merge two rings
-    static Ring _merge_rings(const Ring &ring1, const Ring &ring2)
+    // Estimated mass of the arc ending at ring[r], i.e. the range [ring[r - 1], ring[r]) that routes to ring[r]'s bucket
+    double _arc_mass(uint32_t row, uint32_t r) const
+    {
+        const Ring &ring = m_rings[row];
+        const auto &bucket = m_buckets[row][ring[r].second];
+        if (bucket.count == 0) return 0.0;
+        uint64_t start = ring[r == 0 ? ring.size() - 1 : r - 1].first;
+        uint64_t end = ring[r].first;
+        if (start < end) return bucket.q_sketch.get_count_in_range(start, end);
+        return bucket.q_sketch.get_count_in_range(start, std::numeric_limits<uint64_t>::max()) + bucket.q_sketch.get_count_in_range(0, end);
+    }
+
+    // Load-aware expand: repeatedly splits the heaviest remaining piece of an arc at the weighted median of its retained hashes, so each new
+    // point halves the hottest load. Returns how many points (ids m_width, m_width + 1, ...) were added to new_ring; pieces holding a single
+    // distinct hash cannot be split, so fewer than num_points may be placed. Only the split arcs move data in _remap_row.
+    // A bucket created this way owns a single point, whatever the virtual_nodes setting: it is sized to the load it takes over.
+    uint32_t _split_heaviest_arcs(uint32_t row, uint32_t num_points, Ring &new_ring) const
+    {
+        const Ring &ring = m_rings[row];
+        struct Piece
+        {
+            double mass;
+            uint32_t arc;
+            uint32_t lo, hi;   // range in the arc's sorted hashes; hi == 0 until the arc's hashes are collected
+            bool operator<(const Piece &other) const { return mass < other.mass; }
+        };
+        // Per arc: hashes as clockwise offsets from the arc start, with prefix sums of their weights
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> arc_items(ring.size());
+        std::vector<std::vector<uint64_t>> arc_prefix(ring.size());
+
+        std::priority_queue<Piece> heaviest;
+        for (uint32_t r = 0; r < ring.size(); ++r)
+        {
+            double mass = _arc_mass(row, r);
+            if (mass > 0) heaviest.push({mass, r, 0, 0});
+        }
+
+        uint32_t placed = 0;
+        while (placed < num_points && !heaviest.empty())
+        {
+            Piece piece = heaviest.top();
+            heaviest.pop();
+            uint64_t arc_start = ring[piece.arc == 0 ? ring.size() - 1 : piece.arc - 1].first;
+            auto &items = arc_items[piece.arc];
+            auto &prefix = arc_prefix[piece.arc];
+            if (piece.hi == 0)
+            {
+                uint64_t arc_length = ring[piece.arc].first - arc_start;
+                m_buckets[row][ring[piece.arc].second].q_sketch.for_each_summarized_item(
+                    [&](uint64_t h, uint64_t weight)
+                    {
+                        if (h - arc_start < arc_length || ring.size() == 1) items.emplace_back(h - arc_start, weight);
+                    });
+                std::sort(items.begin(), items.end());
+                // Equal hashes cannot be separated by a point, so they are combined
+                uint32_t distinct = 0;
+                for (uint32_t j = 0; j < items.size(); ++j)
+                {
+                    if (distinct > 0 && items[distinct - 1].first == items[j].first) items[distinct - 1].second += items[j].second;
+                    else
+                        items[distinct++] = items[j];
+                }
+                items.resize(distinct);
+                prefix.assign(1, 0);
+                for (const auto &[offset, weight] : items) prefix.push_back(prefix.back() + weight);
+                piece.hi = items.size();
+            }
+            if (piece.hi - piece.lo < 2) continue;
+
+            // First hash at which the piece's cumulative weight reaches half; the new point takes the hashes before it
+            uint64_t half = prefix[piece.lo] + (prefix[piece.hi] - prefix[piece.lo] + 1) / 2;
+            uint32_t mid = std::upper_bound(prefix.begin() + piece.lo + 1, prefix.begin() + piece.hi + 1, half - 1) - prefix.begin();
+            mid = std::clamp(mid, piece.lo + 1, piece.hi - 1);
+
+            // The point goes strictly between the two neighbouring hashes: a hash equal to a point would be routed to the bucket after it,
+            // but moved with the bucket before it by the (start, end] ranges of _remap_row
+            uint64_t left = items[mid - 1].first, right = items[mid].first;
+            uint64_t point = _quantize_point(arc_start + left + (right - left) / 2);
+            if (point - arc_start <= left || point - arc_start >= right) continue;
+            new_ring.push_back({point, m_width + placed});
+            ++placed;
+
+            double unit = piece.mass / static_cast<double>(prefix[piece.hi] - prefix[piece.lo]);
+            heaviest.push({unit * (prefix[mid] - prefix[piece.lo]), piece.arc, piece.lo, mid});
+            heaviest.push({unit * (prefix[piece.hi] - prefix[mid]), piece.arc, mid, piece.hi});
+        }
+        return placed;
+    }
+
+    // Load-aware shrink: keeps num_buckets buckets, greedily dropping the bucket whose arcs and successor arcs carry the least combined mass
+    // (dropping a point hands its arc to the successor), so hot buckets are not merged with each other. Returns the kept bucket ids.
+    std::vector<bool> _drop_lightest_buckets(uint32_t row, uint32_t num_buckets) const
+    {
+        const Ring &ring = m_rings[row];
+        const uint32_t n = ring.size();
+        std::vector<double> mass(n);
+        std::vector<uint32_t> prev(n), next(n);
+        std::vector<std::vector<uint32_t>> points(m_width);
+        for (uint32_t r = 0; r < n; ++r)
+        {
+            mass[r] = _arc_mass(row, r);
+            prev[r] = (r + n - 1) % n;
+            next[r] = (r + 1) % n;
+            points[ring[r].second].push_back(r);
+        }
+        auto cost = [&](uint32_t id)
+        {
+            double c = 0.0;
+            for (uint32_t r : points[id]) c += mass[r] + mass[next[r]];
+            return std::make_pair(c, id);
+        };
+
+        std::vector<std::pair<double, uint32_t>> costs(m_width);
+        std::set<std::pair<double, uint32_t>> candidates;
+        for (uint32_t id = 0; id < m_width; ++id) candidates.insert(costs[id] = cost(id));
+        std::vector<bool> kept(m_width, true);
+        for (uint32_t remaining = m_width; remaining > std::max(num_buckets, 1u); --remaining)
+        {
+            uint32_t id = candidates.begin()->second;
+            candidates.erase(candidates.begin());
+            kept[id] = false;
+            std::vector<uint32_t> touched;
+            for (uint32_t r : points[id])
+            {
+                uint32_t p = prev[r], s = next[r];
+                mass[s] += mass[r];
+                next[p] = s;
+                prev[s] = p;
+                touched.push_back(ring[p].second);
+                touched.push_back(ring[s].second);
+            }
+            points[id].clear();
+            for (uint32_t other : touched)
+            {
+                if (!kept[other]) continue;
+                candidates.erase(costs[other]);
+                candidates.insert(costs[other] = cost(other));
+            }
+        }
+        return kept;
+    }
+
+    // Water-filling: k_b = clamp(lambda * count_b, k_min, k_max) with the largest lambda whose total stays within width * kll_k
+    void _rebalance_row(std::vector<Bucket> &buckets) const
+    {
+        const uint32_t base_k = m_kll_config.k;
+        const uint32_t k_min = std::min(base_k, min_adaptive_k);
+        const uint32_t k_max = std::max(base_k, std::min(base_k * max_adaptive_k_factor, static_cast<uint32_t>(std::numeric_limits<uint16_t>::max())));
+        const uint64_t budget = static_cast<uint64_t>(base_k) * buckets.size();
+
+        uint64_t max_count = 0;
+        for (const auto &bucket : buckets) max_count = std::max(max_count, bucket.count);
+        if (max_count == 0) return;
+
+        auto target_k = [&](double lambda, uint64_t count)
+        {
+            return static_cast<uint32_t>(std::clamp(std::floor(lambda * static_cast<double>(count)), static_cast<double>(k_min), static_cast<double>(k_max)));
+        };
+        auto total_k = [&](double lambda)
+        {
+            uint64_t total = 0;
+            for (const auto &bucket : buckets) total += target_k(lambda, bucket.count);
+            return total;
+        };
+
+        double lo = 0.0, hi = static_cast<double>(k_max);   // lambda = k_max saturates every non-empty bucket
+        for (int iter = 0; iter < 64; ++iter)
+        {
+            double mid = (lo + hi) / 2.0;
+            if (total_k(mid) <= budget) lo = mid;
+            else
+                hi = mid;
+        }
+
+        for (auto &bucket : buckets)
+        {
+            uint32_t k = target_k(lo, bucket.count);
+            if (k == bucket.q_sketch.get_config().k) continue;
+
+            std::vector<std::pair<uint64_t, uint64_t>> weighted_items;
+            bucket.q_sketch.for_each_summarized_item([&](uint64_t item, uint64_t weight) { weighted_items.emplace_back(item, weight); });
+            bucket.q_sketch = weighted_items.empty() ? Summary(KLLConfig{k}) : Summary::construct_from_weighted_items(weighted_items, KLLConfig{k});
+        }
+    }
+
+    // Helper to merge two rings: every bucket keeps its points, the buckets of ring2 are numbered after the width1 buckets of ring1
+    static Ring _merge_rings(const Ring &ring1, const Ring &ring2, uint32_t width1)
     {
         Ring merged_ring;
         merged_ring.reserve(ring1.size() + ring2.size());
 
-        for (const auto &point : ring1) { merged_ring.push_back({point.first, 0}); }
-        for (const auto &point : ring2) { merged_ring.push_back({point.first, 0}); }
+        for (const auto &point : ring1) { merged_ring.push_back(point); }
+        for (const auto &point : ring2) { merged_ring.push_back({point.first, width1 + point.second}); }
 
         std::sort(merged_ring.begin(), merged_ring.end());
 
-        for (uint32_t i = 0; i < merged_ring.size(); ++i) { merged_ring[i].second = i; }
-
         return merged_ring;
     }
 
@@ -582,16 +1420,36 @@ private:
     ReSketchConfig m_config;
     uint32_t m_width;
     uint32_t m_depth;
-    std::vector<uint32_t> m_seeds;
+    RowArray<uint32_t> m_seeds;
     uint32_t m_partition_seed;   // Seed for the first hashing step (partition hash)
     KLLConfig m_kll_config;
     std::vector<std::pair<uint64_t, uint64_t>> m_partition_ranges;
     // Ranges this sketch is responsible for [(start, end), ...]
-    std::vector<uint64_t> m_a;
-    std::vector<uint64_t> m_b;
-    std::vector<uint64_t> m_a_inv;
+    RowArray<uint64_t> m_a;
+    RowArray<uint64_t> m_b;
+    RowArray<uint64_t> m_a_inv;
     // Pre-calculated modular inverses of 'a' for each row to speed-up the reversible placement hash
 
-    std::vector<Ring> m_rings;
-    std::vector<std::vector<Bucket>> m_buckets;
+    RowArray<Ring> m_rings;
+    RowArray<std::vector<Bucket>> m_buckets;
+    SpaceSaving m_candidates;   // top_k candidates; capacity 0 when disabled
+    HyperLogLog m_distinct;     // over the partition hash; precision 0 when disabled
 };
+
+using ReSketchV2 = BasicReSketchV2<KLL>;
+using ReSketchV2XX = BasicReSketchV2<KLLXX>;
+
+// Compile-time depth variant for the common deployments (depth 3, 4 or 5); ReSketchV2 remains the runtime-depth fallback
+template <uint32_t Depth> using FixedDepthReSketchV2 = BasicReSketchV2<KLL, Depth>;
+
+// Compact mode: 32-bit fingerprints in the buckets, so the memory used matches calculate_max_width
+using CompactReSketchV2 = BasicReSketchV2<CompactKLL>;
+
+// Heap-free buckets: InlineKLL keeps its items inline, so buckets are trivially copyable and contiguous in each row
+template <uint16_t K> using InlineReSketchV2 = BasicReSketchV2<InlineKLL<K>>;
+
+// Lazily materialized buckets: a bucket allocates its KLL on the first update or merge, so wide or freshly expanded sketches stay cheap
+using LazyReSketchV2 = BasicReSketchV2<LazySummary<KLL>>;
+
+// Exact counters per bucket until it sees more than a handful of distinct hashes, then KLL
+using HybridReSketchV2 = BasicReSketchV2<HybridSummary<KLL>>;
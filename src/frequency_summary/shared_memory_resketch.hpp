@@ -0,0 +1,448 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+#include "quantile_summary/kll_inline.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A ReSketchV2 (InlineKLL<K> buckets) that lives entirely in a POSIX shared-memory segment, so capture processes and query processes share
+// one sketch. The segment holds a header, the per-row placement hash parameters, the rings and the buckets, all addressed by offsets from
+// the segment start; any process can map it at any address. Hashing and routing are those of InlineReSketchV2<K>.
+// Single writer, any number of readers: the writer role is claimed with a compare-and-swap on the pid in the header (and taken over from a
+// dead holder); every bucket is guarded by a seqlock, so readers never block the writer and retry a bucket only if it changed under them.
+// The layout is fixed at creation: expand, shrink, split and merge are not available, the width must be chosen up front.
+template <uint16_t K = 64> class SharedMemoryReSketch : public FrequencySummary
+{
+    using Summary = InlineKLL<K>;
+
+    static_assert(std::is_trivially_copyable_v<Summary>, "Bucket summaries in shared memory must be trivially copyable.");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<int32_t>::is_always_lock_free, "Cross-process atomics must be lock-free.");
+
+    static constexpr uint64_t segment_magic = 0x5253484D534B5632ULL;   // "RSHMSKV2"
+    static constexpr uint32_t segment_version = 2;   // 2: InlineKLL buckets sized to the 3k bound
+    static constexpr size_t segment_alignment = 64;
+
+    struct Header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t kll_k;
+        uint32_t depth;
+        uint32_t width;
+        uint32_t ring_size;   // points per row (width * virtual nodes)
+        uint32_t partition_seed;
+        uint32_t invertible_partition_hash;
+        uint64_t segment_size;
+        uint64_t row_offset;      // RowHash[depth]
+        uint64_t ring_offset;     // RingPoint[depth * ring_size]
+        uint64_t bucket_offset;   // Bucket[depth * width]
+        std::atomic<int32_t> writer_pid;   // 0 when no process holds the writer role
+        std::atomic<uint32_t> ready;       // set once the creator has initialized the segment
+    };
+
+    struct RowHash
+    {
+        uint64_t a;
+        uint64_t b;
+    };
+
+    struct RingPoint
+    {
+        uint64_t point;
+        uint32_t bucket_id;
+    };
+
+    // Own cache line per bucket, so the writer updating one bucket does not invalidate readers of its neighbours
+    struct alignas(segment_alignment) Bucket
+    {
+        std::atomic<uint32_t> sequence;   // odd while the writer is changing the bucket
+        uint64_t count;
+        Summary q_sketch;
+    };
+
+    // Keeps a bucket's sequence odd for the span of one write and even again afterwards. A write that throws leaves the bucket reset, as
+    // _repair_buckets does for a writer that died: readers must not spin on an odd sequence, nor see the half-applied update.
+    class BucketWrite
+    {
+    public:
+        explicit BucketWrite(Bucket &bucket) : m_bucket(bucket), m_sequence(bucket.sequence.load(std::memory_order_relaxed))
+        {
+            m_bucket.sequence.store(m_sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ~BucketWrite()
+        {
+            if (!m_done)
+            {
+                m_bucket.count = 0;
+                m_bucket.q_sketch = Summary{};
+            }
+            m_bucket.sequence.store(m_sequence + 2, std::memory_order_release);
+        }
+
+        BucketWrite(const BucketWrite &) = delete;
+        BucketWrite &operator=(const BucketWrite &) = delete;
+
+        void done() { m_done = true; }
+
+    private:
+        Bucket &m_bucket;
+        uint32_t m_sequence;
+        bool m_done = false;
+    };
+
+public:
+    // Creates and initializes a new segment (it must not exist yet); the creating process becomes the writer
+    static SharedMemoryReSketch create(const std::string &name, const ReSketchConfig &config)
+    {
+        if (config.depth == 0 || config.width == 0) { throw std::invalid_argument("Width and depth must be positive."); }
+        if (config.kll_k != K) { throw std::invalid_argument("kll_k must match the K of the shared-memory layout."); }
+        if (config.adaptive_k || config.top_k_candidates != 0 || config.hll_precision != 0)
+        {
+            throw std::invalid_argument("The shared-memory layout supports neither adaptive k, top_k candidates nor HyperLogLog.");
+        }
+
+        uint32_t ring_size = config.width * std::max(config.virtual_nodes, 1u);
+        uint64_t row_offset = _align(sizeof(Header));
+        uint64_t ring_offset = _align(row_offset + sizeof(RowHash) * config.depth);
+        uint64_t bucket_offset = _align(ring_offset + sizeof(RingPoint) * static_cast<uint64_t>(config.depth) * ring_size);
+        uint64_t segment_size = bucket_offset + sizeof(Bucket) * static_cast<uint64_t>(config.depth) * config.width;
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "shm_open " + name); }
+        if (ftruncate(fd, static_cast<off_t>(segment_size)) != 0)
+        {
+            int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::system_error(error, std::generic_category(), "ftruncate " + name);
+        }
+        SharedMemoryReSketch sketch(name, _map(fd, segment_size, PROT_READ | PROT_WRITE, name), segment_size, true);
+        sketch._initialize(config, ring_size, row_offset, ring_offset, bucket_offset);
+        sketch.m_is_writer = true;
+        sketch._header()->ready.store(1, std::memory_order_release);
+        return sketch;
+    }
+
+    // Maps an existing segment; a writer maps it read-write and must then claim the role with try_acquire_writer()
+    static SharedMemoryReSketch open(const std::string &name, bool writable = false)
+    {
+        int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "shm_open " + name); }
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat " + name);
+        }
+        uint64_t segment_size = static_cast<uint64_t>(status.st_size);
+        if (segment_size < sizeof(Header))
+        {
+            close(fd);
+            throw std::runtime_error("Shared-memory segment " + name + " is too small for a ReSketch.");
+        }
+        SharedMemoryReSketch sketch(name, _map(fd, segment_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, name), segment_size, writable);
+        const Header *header = sketch._header();
+        if (header->magic != segment_magic || header->version != segment_version || header->segment_size != segment_size)
+        {
+            throw std::runtime_error("Shared-memory segment " + name + " does not hold a ReSketch of this version.");
+        }
+        if (header->kll_k != K) { throw std::invalid_argument("Shared-memory segment " + name + " was created with another K."); }
+        if (header->ready.load(std::memory_order_acquire) == 0) { throw std::runtime_error("Shared-memory segment " + name + " is still being initialized."); }
+        return sketch;
+    }
+
+    // Removes the name; processes that have the segment mapped keep using it until they unmap it
+    static void unlink(const std::string &name)
+    {
+        if (shm_unlink(name.c_str()) != 0 && errno != ENOENT) { throw std::system_error(errno, std::generic_category(), "shm_unlink " + name); }
+    }
+
+    SharedMemoryReSketch(SharedMemoryReSketch &&other) noexcept
+        : m_name(std::move(other.m_name)), m_segment(std::exchange(other.m_segment, nullptr)), m_segment_size(std::exchange(other.m_segment_size, 0)),
+          m_writable(other.m_writable), m_is_writer(std::exchange(other.m_is_writer, false))
+    {
+    }
+
+    SharedMemoryReSketch &operator=(SharedMemoryReSketch &&other) noexcept
+    {
+        if (this != &other)
+        {
+            _release();
+            m_name = std::move(other.m_name);
+            m_segment = std::exchange(other.m_segment, nullptr);
+            m_segment_size = std::exchange(other.m_segment_size, 0);
+            m_writable = other.m_writable;
+            m_is_writer = std::exchange(other.m_is_writer, false);
+        }
+        return *this;
+    }
+
+    SharedMemoryReSketch(const SharedMemoryReSketch &) = delete;
+    SharedMemoryReSketch &operator=(const SharedMemoryReSketch &) = delete;
+
+    ~SharedMemoryReSketch() { _release(); }
+
+    // Claims the writer role; succeeds if nobody holds it or its holder has exited. A holder that died in the middle of an update leaves
+    // that bucket half-written, so those buckets (odd sequence) are reset: their counts are lost rather than left corrupt.
+    bool try_acquire_writer()
+    {
+        if (m_is_writer) return true;
+        if (!m_writable) { throw std::logic_error("The segment is mapped read-only; open it writable to become the writer."); }
+        Header *header = _header();
+        int32_t self = static_cast<int32_t>(getpid());
+        int32_t holder = header->writer_pid.load(std::memory_order_acquire);
+        while (true)
+        {
+            if (holder != 0 && _is_alive(holder)) return false;
+            if (header->writer_pid.compare_exchange_weak(holder, self, std::memory_order_acq_rel, std::memory_order_acquire)) break;
+        }
+        m_is_writer = true;
+        if (holder != 0) _repair_buckets();
+        return true;
+    }
+
+    void release_writer()
+    {
+        if (!m_is_writer) return;
+        m_is_writer = false;
+        int32_t self = static_cast<int32_t>(getpid());
+        _header()->writer_pid.compare_exchange_strong(self, 0, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    bool is_writer() const { return m_is_writer; }
+
+    void update(uint64_t item) override { update(item, 1); }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (!m_is_writer) { throw std::logic_error("Only the process holding the writer role can update the shared sketch."); }
+        const Header *header = _header();
+        uint64_t partition_h = _partition_hash(item);
+        for (uint32_t i = 0; i < header->depth; ++i)
+        {
+            uint64_t h = _placement_hash(partition_h, i);
+            Bucket &bucket = _buckets(i)[_find_bucket_id(h, i)];
+            BucketWrite write(bucket);
+            bucket.count += weight;
+            if (weight == 1) bucket.q_sketch.update(h);
+            else
+            {
+                bucket.q_sketch.update(h, weight);
+            }
+            write.done();
+        }
+    }
+
+    // Safe from any process while the writer keeps updating
+    double estimate(uint64_t item) const override
+    {
+        const Header *header = _header();
+        uint64_t partition_h = _partition_hash(item);
+        std::vector<double> estimates;
+        estimates.reserve(header->depth);
+        Bucket copy;
+        for (uint32_t i = 0; i < header->depth; ++i)
+        {
+            uint64_t h = _placement_hash(partition_h, i);
+            _read_bucket(_buckets(i)[_find_bucket_id(h, i)], copy);
+            estimates.push_back(copy.q_sketch.estimate(h));
+        }
+        std::sort(estimates.begin(), estimates.end());
+        uint32_t depth = header->depth;
+        if (depth % 2 == 0) { return (estimates[depth / 2 - 1] + estimates[depth / 2]) / 2.0; }
+        else
+        {
+            return estimates[depth / 2];
+        }
+    }
+
+    uint32_t get_width() const { return _header()->width; }
+    uint32_t get_depth() const { return _header()->depth; }
+    uint32_t get_partition_seed() const { return _header()->partition_seed; }
+    const std::string &get_name() const { return m_name; }
+
+    uint64_t get_bucket_count(uint32_t row, uint32_t bucket_id) const
+    {
+        Bucket copy;
+        _read_bucket(_buckets(row)[bucket_id], copy);
+        return copy.count;
+    }
+
+    // The whole segment, shared by every process that maps it
+    size_t get_max_memory_usage() const { return static_cast<size_t>(m_segment_size); }
+
+private:
+    SharedMemoryReSketch(std::string name, std::byte *segment, uint64_t segment_size, bool writable)
+        : m_name(std::move(name)), m_segment(segment), m_segment_size(segment_size), m_writable(writable)
+    {
+    }
+
+    static uint64_t _align(uint64_t offset) { return (offset + segment_alignment - 1) / segment_alignment * segment_alignment; }
+
+    // Closes fd either way; the mapping stays valid without it
+    static std::byte *_map(int fd, uint64_t segment_size, int protection, const std::string &name)
+    {
+        void *segment = mmap(nullptr, segment_size, protection, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (segment == MAP_FAILED) { throw std::system_error(error, std::generic_category(), "mmap " + name); }
+        return static_cast<std::byte *>(segment);
+    }
+
+    static bool _is_alive(int32_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+
+    // Seeds, hash parameters and ring points are drawn as InlineReSketchV2 draws them
+    void _initialize(const ReSketchConfig &config, uint32_t ring_size, uint64_t row_offset, uint64_t ring_offset, uint64_t bucket_offset)
+    {
+        Header *header = new (m_segment) Header{};
+        header->magic = segment_magic;
+        header->version = segment_version;
+        header->kll_k = K;
+        header->depth = config.depth;
+        header->width = config.width;
+        header->ring_size = ring_size;
+        header->invertible_partition_hash = config.invertible_partition_hash;
+        header->segment_size = m_segment_size;
+        header->row_offset = row_offset;
+        header->ring_offset = ring_offset;
+        header->bucket_offset = bucket_offset;
+        header->writer_pid.store(static_cast<int32_t>(getpid()), std::memory_order_relaxed);
+        header->ready.store(0, std::memory_order_relaxed);
+
+        std::mt19937_64 rng(std::random_device{}());
+        std::uniform_int_distribution<uint32_t> seed_dist;
+        std::uniform_int_distribution<uint64_t> param_dist;
+        header->partition_seed = seed_dist(rng);
+        std::vector<uint32_t> seeds(config.depth);
+        for (auto &seed : seeds) seed = seed_dist(rng);
+
+        std::mt19937_64 param_rng;
+        for (uint32_t i = 0; i < config.depth; ++i)
+        {
+            param_rng.seed(seeds[i]);
+            RowHash *row = new (m_segment + row_offset + sizeof(RowHash) * i) RowHash{};
+            row->a = param_dist(param_rng) | 1;
+            row->b = param_dist(param_rng);
+        }
+
+        uint32_t virtual_nodes = ring_size / config.width;
+        for (uint32_t i = 0; i < config.depth; ++i)
+        {
+            RingPoint *ring = new (m_segment + ring_offset + sizeof(RingPoint) * static_cast<uint64_t>(i) * ring_size) RingPoint[ring_size];
+            for (uint32_t j = 0; j < config.width; ++j)
+            {
+                for (uint32_t v = 0; v < virtual_nodes; ++v) ring[j * virtual_nodes + v] = {param_dist(rng), j};
+            }
+            std::sort(ring, ring + ring_size, [](const RingPoint &x, const RingPoint &y) { return x.point != y.point ? x.point < y.point : x.bucket_id < y.bucket_id; });
+        }
+
+        for (uint64_t j = 0; j < static_cast<uint64_t>(config.depth) * config.width; ++j) { new (m_segment + bucket_offset + sizeof(Bucket) * j) Bucket{}; }
+    }
+
+    // Empties every bucket a dead writer left mid-update
+    void _repair_buckets()
+    {
+        const Header *header = _header();
+        for (uint32_t i = 0; i < header->depth; ++i)
+        {
+            Bucket *buckets = _buckets(i);
+            for (uint32_t j = 0; j < header->width; ++j)
+            {
+                uint32_t sequence = buckets[j].sequence.load(std::memory_order_relaxed);
+                if ((sequence & 1) == 0) continue;
+                buckets[j].count = 0;
+                buckets[j].q_sketch = Summary{};
+                buckets[j].sequence.store(sequence + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    // Seqlock read: copy the bucket, then check that no write started or finished meanwhile
+    static void _read_bucket(const Bucket &bucket, Bucket &copy)
+    {
+        for (uint32_t attempt = 0;; ++attempt)
+        {
+            uint32_t before = bucket.sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                copy.count = bucket.count;
+                std::memcpy(static_cast<void *>(&copy.q_sketch), static_cast<const void *>(&bucket.q_sketch), sizeof(Summary));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (bucket.sequence.load(std::memory_order_relaxed) == before) return;
+            }
+            if (attempt >= 64) std::this_thread::yield();
+        }
+    }
+
+    uint64_t _partition_hash(uint64_t item) const
+    {
+        const Header *header = _header();
+        return InlineReSketchV2<K>::compute_partition_hash(item, header->partition_seed, header->invertible_partition_hash != 0);
+    }
+
+    uint64_t _placement_hash(uint64_t partition_h, uint32_t row_index) const
+    {
+        const RowHash &row = reinterpret_cast<const RowHash *>(m_segment + _header()->row_offset)[row_index];
+        return row.a * partition_h + row.b;
+    }
+
+    // The first point above the hash, wrapping around, as in ReSketchV2
+    uint32_t _find_bucket_id(uint64_t item_hash, uint32_t row_index) const
+    {
+        const Header *header = _header();
+        const RingPoint *ring = reinterpret_cast<const RingPoint *>(m_segment + header->ring_offset) + static_cast<uint64_t>(row_index) * header->ring_size;
+        const RingPoint *end = ring + header->ring_size;
+        const RingPoint *it = std::lower_bound(ring, end, item_hash, [](const RingPoint &point, uint64_t h) { return point.point <= h; });
+        return it == end ? ring->bucket_id : it->bucket_id;
+    }
+
+    Header *_header() { return reinterpret_cast<Header *>(m_segment); }
+    const Header *_header() const { return reinterpret_cast<const Header *>(m_segment); }
+
+    Bucket *_buckets(uint32_t row_index) { return reinterpret_cast<Bucket *>(m_segment + _header()->bucket_offset) + static_cast<uint64_t>(row_index) * _header()->width; }
+    const Bucket *_buckets(uint32_t row_index) const
+    {
+        return reinterpret_cast<const Bucket *>(m_segment + _header()->bucket_offset) + static_cast<uint64_t>(row_index) * _header()->width;
+    }
+
+    void _release()
+    {
+        if (m_segment == nullptr) return;
+        release_writer();
+        munmap(m_segment, m_segment_size);
+        m_segment = nullptr;
+    }
+
+    std::string m_name;
+    std::byte *m_segment = nullptr;   // start of the mapping; everything in it is addressed by offset
+    uint64_t m_segment_size = 0;
+    bool m_writable = false;
+    bool m_is_writer = false;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+
+#include <atomic>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// One writer, any number of readers. The writer ingests into a private live sketch and publishes immutable copies of it (RCU style);
+// readers take the current copy with one atomic shared_ptr load and query it without locks, so their overhead is that load per query or
+// per batch. A copy is reclaimed once the last reader drops it: its storage is reused by a later publish when only the publisher still
+// holds it, and at most max_snapshots copies are kept for reuse. Readers see the state of the last publish, not of the latest update.
+// update, publish and get_live_sketch belong to the writer thread; snapshot, estimate and estimate_batch may be called from any thread.
+template <typename Sketch = ReSketchV2> class SnapshotReSketch : public FrequencySummary
+{
+public:
+    // The published copy, one being read by slow readers, and one being refilled
+    static constexpr uint32_t max_snapshots = 3;
+
+    // publish_interval > 0 publishes automatically every that many updates; 0 leaves publishing to the writer
+    explicit SnapshotReSketch(const ReSketchConfig &config, uint64_t publish_interval = 0) : SnapshotReSketch(Sketch(config), publish_interval) {}
+
+    explicit SnapshotReSketch(Sketch sketch, uint64_t publish_interval = 0) : m_live(std::move(sketch)), m_publish_interval(publish_interval) { publish(); }
+
+    void update(uint64_t item) override
+    {
+        m_live.update(item);
+        _tick();
+    }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        m_live.update(item, weight);
+        _tick();
+    }
+
+    // Makes the writer's current state visible to readers
+    void publish()
+    {
+        m_updates_since_publish = 0;
+        std::shared_ptr<Sketch> next = _reclaim();
+        if (next) *next = m_live;
+        else
+        {
+            next = std::make_shared<Sketch>(m_live);
+            if (m_snapshots.size() >= max_snapshots) _forget_oldest();
+            m_snapshots.push_back(next);
+        }
+        next->prepare_concurrent_reads();
+        m_published.store(std::shared_ptr<const Sketch>(next));
+    }
+
+    // A consistent view for any number of queries; stays valid (and unchanged) for as long as the caller holds it
+    std::shared_ptr<const Sketch> snapshot() const { return m_published.load(); }
+
+    double estimate(uint64_t item) const override { return snapshot()->estimate(item); }
+
+    // All items are answered from the same snapshot
+    void estimate_batch(std::span<const uint64_t> items, std::span<double> estimates) const { snapshot()->estimate_batch(items, estimates); }
+
+    // The writer's sketch, e.g. for expand/shrink; changes become visible at the next publish
+    Sketch &get_live_sketch() { return m_live; }
+    const Sketch &get_live_sketch() const { return m_live; }
+
+    // The live sketch plus the retained copies
+    uint32_t get_max_memory_usage() const { return m_live.get_max_memory_usage() * (1 + m_snapshots.size()); }
+
+private:
+    void _tick()
+    {
+        if (m_publish_interval != 0 && ++m_updates_since_publish >= m_publish_interval) publish();
+    }
+
+    // A retained copy nobody else holds: not published (the atomic holds a reference) and not held by any reader. A reader can only obtain a
+    // copy from the atomic, so once the count has dropped to one it cannot rise again until the copy is republished.
+    std::shared_ptr<Sketch> _reclaim()
+    {
+        for (const auto &candidate : m_snapshots)
+        {
+            if (candidate.use_count() == 1)
+            {
+                // Pairs with the release in the last reader's reference drop, so its reads happen before the refill
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return candidate;
+            }
+        }
+        return nullptr;
+    }
+
+    // Stops retaining the oldest copy that is not published; readers still holding it keep it alive and the last one frees it
+    void _forget_oldest()
+    {
+        const Sketch *published = m_published.load().get();
+        for (auto it = m_snapshots.begin(); it != m_snapshots.end(); ++it)
+        {
+            if (it->get() != published)
+            {
+                m_snapshots.erase(it);
+                return;
+            }
+        }
+    }
+
+    Sketch m_live;
+    uint64_t m_publish_interval;
+    uint64_t m_updates_since_publish = 0;
+    std::vector<std::shared_ptr<Sketch>> m_snapshots;   // copies available for reuse, oldest first; one of them is published
+    std::atomic<std::shared_ptr<const Sketch>> m_published;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "frequency_summary.hpp"
+
+#include "utils/BinaryStream.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Space-Saving (Metwally et al.) over a bounded set of counters, kept as an indexed min-heap so both hits and replacements are O(log capacity).
+// Every item whose true count exceeds N / capacity is guaranteed to be in the table; a counter overestimates by at most its recorded error.
+class SpaceSaving : public FrequencySummary
+{
+public:
+    struct Counter
+    {
+        uint64_t item;
+        uint64_t count;
+        uint64_t error;   // count inherited from the evicted counter, i.e. the possible overestimate
+    };
+
+    explicit SpaceSaving(uint32_t capacity = 0) : m_capacity(capacity)
+    {
+        m_heap.reserve(capacity);
+        m_index.reserve(capacity);
+    }
+
+    void update(uint64_t item) override { update(item, 1); }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (m_capacity == 0 || weight == 0) return;
+        auto it = m_index.find(item);
+        if (it != m_index.end())
+        {
+            m_heap[it->second].count += weight;
+            _sift_down(it->second);
+            return;
+        }
+        if (m_heap.size() < m_capacity)
+        {
+            m_heap.push_back({item, weight, 0});
+            m_index[item] = m_heap.size() - 1;
+            _sift_up(m_heap.size() - 1);
+            return;
+        }
+        // Replace the minimum counter: the newcomer inherits its count as error
+        Counter &min = m_heap.front();
+        m_index.erase(min.item);
+        min = {item, min.count + weight, min.count};
+        m_index[item] = 0;
+        _sift_down(0);
+    }
+
+    double estimate(uint64_t item) const override
+    {
+        auto it = m_index.find(item);
+        return it != m_index.end() ? static_cast<double>(m_heap[it->second].count) : 0.0;
+    }
+
+    bool contains(uint64_t item) const { return m_index.contains(item); }
+
+    // Smallest count in a full table: the bound on any untracked item's count (0 while the table still has room)
+    uint64_t get_min_count() const { return m_heap.size() < m_capacity || m_heap.empty() ? 0 : m_heap.front().count; }
+
+    // Mergeable summaries (Agarwal et al.): an item missing from one side is charged that side's minimum, then the largest capacity counters are kept
+    static SpaceSaving merge(const SpaceSaving &s1, const SpaceSaving &s2)
+    {
+        SpaceSaving merged(std::max(s1.m_capacity, s2.m_capacity));
+        std::unordered_map<uint64_t, Counter> combined;
+        for (const auto &counter : s1.m_heap)
+        {
+            auto &c = combined.try_emplace(counter.item, Counter{counter.item, 0, 0}).first->second;
+            c.count += counter.count;
+            c.error += counter.error;
+        }
+        for (const auto &counter : s2.m_heap)
+        {
+            auto &c = combined.try_emplace(counter.item, Counter{counter.item, s1.get_min_count(), s1.get_min_count()}).first->second;
+            c.count += counter.count;
+            c.error += counter.error;
+        }
+        for (auto &[item, c] : combined)
+        {
+            if (!s2.contains(item))
+            {
+                c.count += s2.get_min_count();
+                c.error += s2.get_min_count();
+            }
+        }
+
+        std::vector<Counter> counters;
+        counters.reserve(combined.size());
+        for (const auto &[item, c] : combined) counters.push_back(c);
+        merged._assign_largest(std::move(counters));
+        return merged;
+    }
+
+    // Keeps the counters whose item satisfies pred (e.g. the partition a split sketch is responsible for)
+    template <typename Pred> SpaceSaving filter(Pred &&pred) const
+    {
+        SpaceSaving result(m_capacity);
+        std::vector<Counter> counters;
+        for (const auto &counter : m_heap)
+        {
+            if (pred(counter.item)) counters.push_back(counter);
+        }
+        result._assign_largest(std::move(counters));
+        return result;
+    }
+
+    // Divides every counter by 2^shift; the mapping is monotone, so the heap order is preserved
+    void downscale(uint32_t shift)
+    {
+        for (auto &counter : m_heap)
+        {
+            counter.count = shift < 64 ? counter.count >> shift : 0;
+            counter.error = shift < 64 ? counter.error >> shift : 0;
+        }
+    }
+
+    void clear()
+    {
+        m_heap.clear();
+        m_index.clear();
+    }
+
+    const std::vector<Counter> &get_counters() const { return m_heap; }
+    uint32_t get_capacity() const { return m_capacity; }
+
+    uint32_t get_max_memory_usage() const { return m_capacity * (sizeof(Counter) + sizeof(std::pair<uint64_t, size_t>)); }
+
+    void serialize(std::ostream &os) const
+    {
+        binary_stream::write<uint32_t>(os, m_capacity);
+        binary_stream::write_vector(os, m_heap);
+    }
+
+    static SpaceSaving deserialize(std::istream &is)
+    {
+        SpaceSaving result(binary_stream::read<uint32_t>(is));
+        result._assign_largest(binary_stream::read_vector<Counter>(is));
+        return result;
+    }
+
+private:
+    void _assign_largest(std::vector<Counter> counters)
+    {
+        if (counters.size() > m_capacity)
+        {
+            std::nth_element(counters.begin(), counters.begin() + m_capacity, counters.end(), [](const Counter &a, const Counter &b) { return a.count > b.count; });
+            counters.resize(m_capacity);
+        }
+        m_heap = std::move(counters);
+        std::make_heap(m_heap.begin(), m_heap.end(), [](const Counter &a, const Counter &b) { return a.count > b.count; });
+        m_index.clear();
+        for (size_t i = 0; i < m_heap.size(); ++i) m_index[m_heap[i].item] = i;
+    }
+
+    void _swap(size_t i, size_t j)
+    {
+        std::swap(m_heap[i], m_heap[j]);
+        m_index[m_heap[i].item] = i;
+        m_index[m_heap[j].item] = j;
+    }
+
+    void _sift_up(size_t i)
+    {
+        while (i > 0)
+        {
+            size_t parent = (i - 1) / 2;
+            if (m_heap[parent].count <= m_heap[i].count) break;
+            _swap(i, parent);
+            i = parent;
+        }
+    }
+
+    void _sift_down(size_t i)
+    {
+        while (true)
+        {
+            size_t smallest = i;
+            size_t left = 2 * i + 1, right = 2 * i + 2;
+            if (left < m_heap.size() && m_heap[left].count < m_heap[smallest].count) smallest = left;
+            if (right < m_heap.size() && m_heap[right].count < m_heap[smallest].count) smallest = right;
+            if (smallest == i) break;
+            _swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    uint32_t m_capacity;
+    std::vector<Counter> m_heap;   // min-heap on count
+    std::unordered_map<uint64_t, size_t> m_index;
+};
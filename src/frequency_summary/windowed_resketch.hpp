@@ -0,0 +1,81 @@
+#pragma once
+
+#include "frequency_summary_config.hpp"
+
+#include "frequency_summary.hpp"
+#include "frequency_summary/resketchv2.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Sliding window over the last num_epochs epochs, kept as a ring of epoch sketches.
+// All epochs are copies of one empty sketch, so they share seeds and rings and can be merged bucket by bucket.
+// advance() closes the current epoch and reuses the oldest one's slot with reset(): the ring stays num_epochs long, so memory stays bounded
+// under continuous ingest, though each bucket summary is rebuilt empty rather than cleared in place.
+template <typename Sketch = ReSketchV2> class WindowedReSketch : public FrequencySummary
+{
+public:
+    WindowedReSketch(const ReSketchConfig &config, uint32_t num_epochs) : WindowedReSketch(Sketch(config), num_epochs) {}
+
+    // All epochs start as copies of the given sketch, which should be empty
+    WindowedReSketch(const Sketch &empty_sketch, uint32_t num_epochs)
+    {
+        if (num_epochs == 0) { throw std::invalid_argument("Window must hold at least one epoch."); }
+        m_epochs.assign(num_epochs, empty_sketch);
+    }
+
+    void update(uint64_t item) override
+    {
+        m_epochs[m_current].update(item);
+        m_window.reset();
+    }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        m_epochs[m_current].update(item, weight);
+        m_window.reset();
+    }
+
+    // Window estimate: the sum of the per-epoch estimates, each with the error of a single epoch sketch
+    double estimate(uint64_t item) const override
+    {
+        double estimated_count = 0.0;
+        for (const auto &epoch : m_epochs) { estimated_count += epoch.estimate(item); }
+        return estimated_count;
+    }
+
+    // Starts a new epoch; the oldest epoch leaves the window and its storage becomes the new current epoch
+    void advance()
+    {
+        m_current = (m_current + 1) % m_epochs.size();
+        m_epochs[m_current].reset();
+        m_window.reset();
+    }
+
+    // The whole window merged into one sketch (e.g. for top_k or heavy_hitters); cached until the next update or advance.
+    // Shared rather than referenced, so a caller's copy stays valid after the cache is dropped.
+    std::shared_ptr<const Sketch> get_window_sketch() const
+    {
+        if (!m_window)
+        {
+            auto window = std::make_shared<Sketch>(m_epochs[m_current]);
+            for (uint32_t i = 0; i < m_epochs.size(); ++i)
+            {
+                if (i != m_current) window->merge_in_place(m_epochs[i]);
+            }
+            m_window = std::move(window);
+        }
+        return m_window;
+    }
+
+    const Sketch &get_current_epoch() const { return m_epochs[m_current]; }
+    uint32_t get_num_epochs() const { return m_epochs.size(); }
+
+    uint32_t get_max_memory_usage() const { return m_epochs.front().get_max_memory_usage() * m_epochs.size(); }
+
+private:
+    std::vector<Sketch> m_epochs;
+    uint32_t m_current = 0;
+    mutable std::shared_ptr<const Sketch> m_window;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "quantile_summary_config.hpp"
+
+#include <concepts>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Requirements on the quantile summary kept inside every ReSketch bucket.
+// The summary is resolved at compile time, so any type satisfying this concept can be plugged into BasicReSketchV2 without virtual calls.
+template <typename S>
+concept BucketSummary = std::copy_constructible<S> && std::movable<S> && std::constructible_from<S, const KLLConfig &> &&
+                        requires(S s, const S cs, uint64_t item, uint64_t weight, const std::vector<std::pair<uint64_t, uint64_t>> &weighted_items, const KLLConfig &config) {
+                            s.update(item);
+                            s.update(item, weight);
+                            s.merge(cs);
+                            { cs.estimate(item) } -> std::convertible_to<double>;
+                            { cs.get_count_in_range(item, item) } -> std::convertible_to<double>;
+                            { cs.rebuild(item, item) } -> std::same_as<S>;
+                            cs.for_each_summarized_item([](uint64_t, uint64_t) {});
+                            { cs.get_max_memory_usage() } -> std::convertible_to<uint32_t>;
+                            { cs.get_config() } -> std::convertible_to<const KLLConfig &>;
+                            { S::construct_from_weighted_items(weighted_items, config) } -> std::same_as<S>;
+                        };
+
+// Number of placement-hash bits a bucket summary retains. Summaries storing 32-bit fingerprints declare `static constexpr uint32_t hash_bits = 32`,
+// which switches ReSketch into compact mode (32-bit placement hashes and quantized ring points).
+template <typename S> constexpr uint32_t summary_hash_bits = 64;
+template <typename S>
+    requires requires { S::hash_bits; }
+constexpr uint32_t summary_hash_bits<S> = S::hash_bits;
+
+// Whether a summary can be built with a k other than the sketch-wide one, as adaptive per-bucket k requires.
+// Summaries whose k is a template parameter declare `static constexpr bool fixed_k = true`.
+template <typename S> constexpr bool summary_supports_variable_k = true;
+template <typename S>
+    requires requires { S::fixed_k; }
+constexpr bool summary_supports_variable_k<S> = !S::fixed_k;
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "quantile_summary_config.hpp"
+
+#include "quantile_summary/bucket_summary.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Bucket summary that counts exactly while it has seen only a few distinct placement hashes.
+// The exact form is a sorted (hash, count) table, so a bucket hit by one heavy item a million times holds one entry instead of going through
+// KLL compactions. The table holds as many entries as fit in the memory S reports for the configured k (3k/4 for KLL), so the bucket never
+// needs more than S would; one more distinct hash turns the table into S, weights included.
+template <BucketSummary S> class HybridSummary
+{
+    // Sorted by hash, counts are never 0
+    struct ExactTable
+    {
+        std::vector<std::pair<uint64_t, uint64_t>> entries;
+    };
+
+public:
+    // Keep compact mode working when the wrapped summary stores fingerprints
+    static constexpr uint32_t hash_bits = summary_hash_bits<S>;
+    static constexpr bool fixed_k = !summary_supports_variable_k<S>;
+
+    explicit HybridSummary(const KLLConfig &config) : HybridSummary(config, S(config).get_max_memory_usage()) {}
+
+    HybridSummary() : HybridSummary(KLLConfig{30}) {}
+
+    void update(uint64_t item) { update(item, 1); }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        if (auto *table = std::get_if<ExactTable>(&m_state))
+        {
+            if (_add(*table, item, weight)) return;
+            _upgrade();
+        }
+        std::get<S>(m_state).update(item, weight);
+    }
+
+    void merge(const HybridSummary &other)
+    {
+        if (const auto *other_table = std::get_if<ExactTable>(&other.m_state))
+        {
+            for (const auto &[h, count] : other_table->entries)
+            {
+                if (count > 0) update(h, count);
+            }
+            return;
+        }
+        if (is_exact()) _upgrade();
+        std::get<S>(m_state).merge(std::get<S>(other.m_state));
+    }
+
+    double estimate(uint64_t item) const
+    {
+        if (const auto *table = std::get_if<ExactTable>(&m_state))
+        {
+            auto it = _find(*table, item);
+            return it != table->entries.end() && it->first == item ? static_cast<double>(it->second) : 0.0;
+        }
+        return std::get<S>(m_state).estimate(item);
+    }
+
+    double get_count_in_range(uint64_t start_h, uint64_t end_h) const
+    {
+        if (const auto *table = std::get_if<ExactTable>(&m_state))
+        {
+            double count = 0.0;
+            auto it = std::partition_point(table->entries.begin(), table->entries.end(), [&](const auto &entry) { return entry.first <= start_h; });
+            for (; it != table->entries.end() && it->first <= end_h; ++it) count += static_cast<double>(it->second);
+            return count;
+        }
+        return std::get<S>(m_state).get_count_in_range(start_h, end_h);
+    }
+
+    // Keeps (start_h, end_h]; an exact bucket stays exact, a summarized one stays summarized
+    HybridSummary rebuild(uint64_t start_h, uint64_t end_h) const
+    {
+        HybridSummary new_summary(m_config, m_summary_budget);
+        if (const auto *table = std::get_if<ExactTable>(&m_state))
+        {
+            auto &new_entries = std::get<ExactTable>(new_summary.m_state).entries;
+            for (const auto &[h, c] : table->entries)
+            {
+                if (h > start_h && h <= end_h) new_entries.emplace_back(h, c);
+            }
+            return new_summary;
+        }
+        new_summary.m_state = std::get<S>(m_state).rebuild(start_h, end_h);
+        return new_summary;
+    }
+
+    template <typename Func> void for_each_summarized_item(Func &&func) const
+    {
+        if (const auto *table = std::get_if<ExactTable>(&m_state))
+        {
+            for (const auto &[h, c] : table->entries) func(h, c);
+            return;
+        }
+        std::get<S>(m_state).for_each_summarized_item(std::forward<Func>(func));
+    }
+
+    static HybridSummary construct_from_weighted_items(const std::vector<std::pair<uint64_t, uint64_t>> &weighted_items, const KLLConfig &config)
+    {
+        HybridSummary result(config);
+        std::map<uint64_t, uint64_t> aggregated;
+        for (const auto &[item, weight] : weighted_items)
+        {
+            if (weight > 0) aggregated[item] += weight;
+        }
+
+        if (aggregated.size() <= result._max_distinct())
+        {
+            std::get<ExactTable>(result.m_state).entries.assign(aggregated.begin(), aggregated.end());
+            return result;
+        }
+        result.m_state = S::construct_from_weighted_items(weighted_items, config);
+        return result;
+    }
+
+    const KLLConfig &get_config() const { return m_config; }
+
+    // The exact table never outgrows the budget of S, so this is the budget of S
+    uint32_t get_max_memory_usage() const { return is_exact() ? m_summary_budget : std::get<S>(m_state).get_max_memory_usage(); }
+
+    bool is_exact() const { return std::holds_alternative<ExactTable>(m_state); }
+
+    friend std::ostream &operator<<(std::ostream &os, const HybridSummary &summary)
+    {
+        if (const auto *table = std::get_if<ExactTable>(&summary.m_state))
+        {
+            os << "Hybrid summary (exact):" << std::endl;
+            os << "  distinct: " << table->entries.size() << " / " << summary._max_distinct() << std::endl;
+            return os;
+        }
+        return os << std::get<S>(summary.m_state);
+    }
+
+private:
+    // Summaries cut from this one share its k, so they take its budget instead of building an S to ask again
+    HybridSummary(const KLLConfig &config, uint32_t summary_budget) : m_config(config), m_summary_budget(summary_budget) {}
+
+    uint32_t _max_distinct() const { return std::max<uint32_t>(m_summary_budget / sizeof(std::pair<uint64_t, uint64_t>), 1); }
+
+    template <typename Table> static auto _find(Table &table, uint64_t h)
+    {
+        return std::lower_bound(table.entries.begin(), table.entries.end(), h, [](const auto &entry, uint64_t value) { return entry.first < value; });
+    }
+
+    // Adds weight to h; false if h is new and the table is full
+    bool _add(ExactTable &table, uint64_t h, uint64_t weight) const
+    {
+        uint32_t max_distinct = _max_distinct();
+        if (table.entries.empty()) table.entries.reserve(max_distinct);
+        auto it = _find(table, h);
+        if (it != table.entries.end() && it->first == h)
+        {
+            it->second += weight;
+            return true;
+        }
+        if (table.entries.size() >= max_distinct) return false;
+        table.entries.emplace(it, h, weight);
+        return true;
+    }
+
+    void _upgrade() { m_state = S::construct_from_weighted_items(std::get<ExactTable>(m_state).entries, m_config); }
+
+    KLLConfig m_config;
+    uint32_t m_summary_budget;   // memory S reports for this k, fixed for the life of the summary
+    std::variant<ExactTable, S> m_state;
+};
@@ -61,9 +61,9 @@ public:
         merge(*other_kll);
     }
 
+    // The other sketch's k may differ: its levels are absorbed and then compacted to this sketch's capacities
     void merge(const KLLXX &other_kll)
     {
-        if (m_config.k != other_kll.m_config.k) { throw std::invalid_argument("KLLXX sketches must have the same k parameter to be merged."); }
         m_n += other_kll.m_n;
         uint32_t max_level = std::max(m_compactors.size(), other_kll.m_compactors.size());
         if (m_compactors.size() < max_level) m_compactors.resize(max_level);
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "quantile_summary_config.hpp"
+
+#include "frequency_summary/frequency_summary.hpp"
+#include "quantile_summary.hpp"
+
+#include <kll/kll_sketch.hpp>
+
+#include <cmath>
+#include <functional>
+
+// KLL adapter that keeps only the upper 32 bits (the fingerprint) of every 64-bit placement hash, using Apache DataSketches kll_sketch<uint32_t> internally.
+// Items are handed back as (fingerprint << 32) | 0xFFFFFFFF; ranges (start, end] over 64-bit hashes are translated to the exact set of fingerprints
+// whose representative falls inside them.
+class CompactKLL : public QuantileSummary, public FrequencySummary
+{
+public:
+    // Placement-hash bits retained by this summary (see summary_hash_bits)
+    static constexpr uint32_t hash_bits = 32;
+    static constexpr uint64_t low_mask = 0xFFFFFFFFULL;
+
+    explicit CompactKLL(const KLLConfig &config) : m_config(config), m_sketch(static_cast<uint16_t>(config.k)) {}
+
+    CompactKLL() : m_config({30}), m_sketch(30) {}
+
+    CompactKLL(const CompactKLL &other) = default;
+    CompactKLL &operator=(const CompactKLL &other) = default;
+    CompactKLL(CompactKLL &&other) noexcept = default;
+    CompactKLL &operator=(CompactKLL &&other) noexcept = default;
+
+    static uint32_t to_fingerprint(uint64_t hash) { return static_cast<uint32_t>(hash >> 32); }
+    static uint64_t from_fingerprint(uint32_t fingerprint) { return (static_cast<uint64_t>(fingerprint) << 32) | low_mask; }
+
+    // QuantileSummary interface
+    void update(uint64_t item) override { m_sketch.update(to_fingerprint(item)); }
+
+    void merge(const QuantileSummary &other) override
+    {
+        const auto *other_kll = dynamic_cast<const CompactKLL *>(&other);
+        if (!other_kll) { throw std::invalid_argument("Can only merge CompactKLL with another CompactKLL."); }
+        merge(*other_kll);
+    }
+
+    // Sketches with a different k can be merged, as for KLL
+    void merge(const CompactKLL &other_kll) { m_sketch.merge(other_kll.m_sketch); }
+
+    double get_rank(uint64_t value) const override
+    {
+        if (m_sketch.is_empty()) return 0.0;
+        return m_sketch.get_rank(to_fingerprint(value));
+    }
+
+    // FrequencySummary interface
+    double estimate(uint64_t item) const override { return m_sketch.estimate(to_fingerprint(item)); }
+
+    // Additional methods
+    const KLLConfig &get_config() const { return m_config; }
+
+    double get_count_in_range(uint64_t start_h, uint64_t end_h) const
+    {
+        uint32_t first = 0, last = 0;
+        if (m_sketch.is_empty() || !_fingerprint_range(start_h, end_h, first, last)) return 0.0;
+        return (m_sketch.get_rank(last, true) - m_sketch.get_rank(first, false)) * m_sketch.get_n();
+    }
+
+    CompactKLL rebuild(uint64_t start_h, uint64_t end_h) const
+    {
+        CompactKLL new_kll(m_config);
+        uint32_t first = 0, last = 0;
+        if (m_sketch.is_empty() || !_fingerprint_range(start_h, end_h, first, last)) return new_kll;
+        // kll_sketch::rebuild keeps (start, end], which cannot express a range starting at fingerprint 0
+        if (first > 0) { new_kll.m_sketch = m_sketch.rebuild(first - 1, last); }
+        else
+        {
+            std::vector<std::pair<uint32_t, uint64_t>> kept;
+            m_sketch.for_each_summarized_item(
+                [&](uint32_t fingerprint, uint64_t weight)
+                {
+                    if (fingerprint <= last) kept.emplace_back(fingerprint, weight);
+                });
+            new_kll.m_sketch = datasketches::kll_sketch<uint32_t>::construct_from_weighted_items(kept, static_cast<uint16_t>(m_config.k));
+        }
+        return new_kll;
+    }
+
+    void for_each_summarized_item(const std::function<void(uint64_t item, uint64_t weight)> &func) const
+    {
+        m_sketch.for_each_summarized_item([&](uint32_t fingerprint, uint64_t weight) { func(from_fingerprint(fingerprint), weight); });
+    }
+
+    static CompactKLL construct_from_weighted_items(const std::vector<std::pair<uint64_t, uint64_t>> &weighted_items, const KLLConfig &config)
+    {
+        std::vector<std::pair<uint32_t, uint64_t>> fingerprints;
+        fingerprints.reserve(weighted_items.size());
+        for (const auto &[item, weight] : weighted_items) { fingerprints.emplace_back(to_fingerprint(item), weight); }
+
+        CompactKLL result(config);
+        result.m_sketch = datasketches::kll_sketch<uint32_t>::construct_from_weighted_items(fingerprints, static_cast<uint16_t>(config.k));
+        return result;
+    }
+
+    // Weighted update: the weight is split into its binary digits, i.e. O(log weight) items placed directly on their levels
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        if (weight == 1)
+        {
+            update(item);
+            return;
+        }
+        m_sketch.merge(datasketches::kll_sketch<uint32_t>::construct_from_weighted_items({{to_fingerprint(item), weight}}, static_cast<uint16_t>(m_config.k)));
+    }
+
+    // Items really are 32-bit here, so this matches the memory actually retained
+    uint32_t get_max_memory_usage() const
+    {
+        uint32_t max_stored_items = static_cast<uint32_t>(std::ceil(m_config.k / (1.0 - 2.0 / 3.0)));
+        return max_stored_items * sizeof(uint32_t);
+    }
+
+    static uint32_t calculate_max_k(uint32_t total_memory_bytes, double c = 2.0 / 3.0)
+    {
+        const uint32_t item_size = sizeof(uint32_t);
+        if (total_memory_bytes < item_size || (1.0 - c) <= 0) { return 0; }
+
+        uint32_t max_storable_items = total_memory_bytes / item_size;
+        double k = static_cast<double>(max_storable_items) * (1.0 - c);
+
+        return static_cast<uint32_t>(std::floor(k));
+    }
+
+    const datasketches::kll_sketch<uint32_t> &get_sketch() const { return m_sketch; }
+
+    bool is_empty() const { return m_sketch.is_empty(); }
+    uint64_t get_n() const { return m_sketch.get_n(); }
+    uint32_t get_k() const { return m_sketch.get_k(); }
+    uint32_t get_num_retained() const { return m_sketch.get_num_retained(); }
+    uint8_t get_num_levels() const { return m_sketch.get_num_levels(); }
+
+    friend std::ostream &operator<<(std::ostream &os, const CompactKLL &kll)
+    {
+        os << "Compact KLL Sketch (Apache DataSketches, 32-bit fingerprints):" << std::endl;
+        os << "  k: " << kll.m_config.k << std::endl;
+        os << "  count: " << kll.m_sketch.get_n() << std::endl;
+        os << "  num_levels: " << static_cast<int>(kll.m_sketch.get_num_levels()) << std::endl;
+        return os;
+    }
+
+private:
+    // Inclusive fingerprint range [first, last] whose representatives lie in (start_h, end_h]; false if it is empty
+    static bool _fingerprint_range(uint64_t start_h, uint64_t end_h, uint32_t &first, uint32_t &last)
+    {
+        if (start_h >= end_h) return false;
+        uint64_t first_fp = (start_h >> 32) + ((start_h & low_mask) == low_mask ? 1 : 0);
+        if ((end_h & low_mask) != low_mask && (end_h >> 32) == 0) return false;
+        uint64_t last_fp = (end_h & low_mask) == low_mask ? (end_h >> 32) : (end_h >> 32) - 1;
+        if (first_fp > last_fp) return false;
+        first = static_cast<uint32_t>(first_fp);
+        last = static_cast<uint32_t>(last_fp);
+        return true;
+    }
+
+    KLLConfig m_config;
+    datasketches::kll_sketch<uint32_t> m_sketch;
+};
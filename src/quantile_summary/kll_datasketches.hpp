@@ -42,11 +42,8 @@ public:
         merge(*other_kll);
     }
 
-    void merge(const KLL &other_kll)
-    {
-        if (m_config.k != other_kll.m_config.k) { throw std::invalid_argument("KLL sketches must have the same k parameter to be merged."); }
-        m_sketch.merge(other_kll.m_sketch);
-    }
+    // Sketches with a different k can be merged: DataSketches keeps this sketch's k and tracks the smallest k merged in for its error bound
+    void merge(const KLL &other_kll) { m_sketch.merge(other_kll.m_sketch); }
 
     double get_rank(uint64_t value) const override
     {
@@ -79,6 +76,18 @@ public:
         return result;
     }
 
+    // Weighted update: the weight is split into its binary digits, i.e. O(log weight) items placed directly on their levels
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        if (weight == 1)
+        {
+            m_sketch.update(item);
+            return;
+        }
+        m_sketch.merge(datasketches::kll_sketch<uint64_t>::construct_from_weighted_items({{item, weight}}, static_cast<uint16_t>(m_config.k)));
+    }
+
     // NOTE: actually apache datasketches KLL does not provide a way to set c explicitly
     uint32_t get_max_memory_usage() const
     {
@@ -86,7 +95,7 @@ public:
         // This comes from the sum of the geometric series of capacities: k / (1 - c).
         // For c = 2/3, this is k / (1/3) = 3k.
         uint32_t max_stored_items = static_cast<uint32_t>(std::ceil(m_config.k / (1.0 - 2.0 / 3.0)));
-        return max_stored_items * sizeof(uint32_t);   // Assuming each item is stored as a 32-bit integer without changing all the types
+        return max_stored_items * sizeof(uint32_t);   // Accounted as 32-bit items; kll_sketch<uint64_t> really holds 8 bytes each, CompactKLL is the variant that matches this budget
     }
 
     static uint32_t calculate_max_k(uint32_t total_memory_bytes, double c = 2.0 / 3.0)
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "quantile_summary_config.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// KLL with a compile-time k and fixed-capacity inline storage: no heap allocation, no allocator, trivially copyable.
+// Levels are laid out like Apache DataSketches: level 0 sits at the bottom of the used region, the top level ends at the end of the buffer,
+// and the free space is below level 0. Level capacities are ceil(k * c^depth) (depth counted from the top level, c = 2/3), and the buffer
+// only holds the terms of that series that are at least 1, i.e. about 3k items; the levels below them share it.
+// Compaction is lazy: nothing is compacted until the buffer is full, then the lowest level at or over its capacity is halved, keeping
+// the unpaired item of an odd level on that level so the retained weight always equals n.
+// MaxLevels defaults to 64, one level per bit of a uint64 weight, which is as far as a uint64 count reaches.
+template <uint16_t K, uint8_t MaxLevels = 64> class InlineKLL
+{
+    static_assert(K >= 2, "InlineKLL needs k >= 2.");
+    static_assert(MaxLevels >= 2 && MaxLevels <= 64, "InlineKLL supports between 2 and 64 levels (weights up to 2^63).");
+
+    static constexpr std::array<uint16_t, MaxLevels> _compute_level_capacities()
+    {
+        std::array<uint16_t, MaxLevels> capacities{};
+        double scaled = K;
+        for (uint32_t depth = 0; depth < MaxLevels; ++depth)
+        {
+            uint32_t capacity = static_cast<uint32_t>(scaled);
+            if (static_cast<double>(capacity) < scaled) ++capacity;   // ceil
+            capacities[depth] = static_cast<uint16_t>(capacity);
+            scaled *= 2.0 / 3.0;
+        }
+        return capacities;
+    }
+
+    static constexpr uint32_t _compute_storage_capacity()
+    {
+        uint32_t total = 0;
+        double scaled = K;
+        for (uint32_t depth = 0; depth < MaxLevels && scaled >= 1.0; ++depth, scaled *= 2.0 / 3.0) { total += level_capacities[depth]; }
+        return total;
+    }
+
+public:
+    // k is part of the type, so ReSketch cannot vary it per bucket
+    static constexpr bool fixed_k = true;
+
+    // Capacity of a level by its depth below the top level
+    static constexpr std::array<uint16_t, MaxLevels> level_capacities = _compute_level_capacities();
+    static constexpr uint32_t storage_capacity = _compute_storage_capacity();
+    static_assert(storage_capacity <= std::numeric_limits<uint16_t>::max(), "k is too large for InlineKLL.");
+
+private:
+    using Offset = std::conditional_t<storage_capacity <= std::numeric_limits<uint8_t>::max(), uint8_t, uint16_t>;
+
+public:
+
+    InlineKLL() : m_n(0), m_num_levels(1), m_rng_state(_next_seed())
+    {
+        m_levels.fill(storage_capacity);
+    }
+
+    explicit InlineKLL(const KLLConfig &config) : InlineKLL()
+    {
+        if (config.k != K) { throw std::invalid_argument("KLLConfig k does not match the compile-time k of InlineKLL."); }
+    }
+
+    void update(uint64_t item)
+    {
+        _insert(0, item);
+        ++m_n;
+    }
+
+    // Weighted update: one item per set bit of the weight, placed directly on its level
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        m_n += weight;
+        for (uint32_t level = 0; weight > 0; ++level, weight >>= 1)
+        {
+            if (weight & 1) { _insert(level, item); }
+        }
+    }
+
+    void merge(const InlineKLL &other)
+    {
+        if (other.m_n == 0) return;
+        m_n += other.m_n;
+        for (uint32_t level = 0; level < other.m_num_levels; ++level)
+        {
+            for (uint32_t i = other.m_levels[level]; i < other.m_levels[level + 1]; ++i) { _insert(level, other.m_items[i]); }
+        }
+    }
+
+    double estimate(uint64_t item) const
+    {
+        double estimated_count = 0.0;
+        _for_each_retained(
+            [&](uint64_t value, uint64_t weight)
+            {
+                if (value == item) estimated_count += static_cast<double>(weight);
+            });
+        return estimated_count;
+    }
+
+    double get_rank(uint64_t value) const
+    {
+        double rank = 0.0;
+        _for_each_retained(
+            [&](uint64_t item, uint64_t weight)
+            {
+                if (item <= value) rank += static_cast<double>(weight);
+            });
+        return rank;
+    }
+
+    double get_count_in_range(uint64_t start_h, uint64_t end_h) const
+    {
+        double estimated_count = 0.0;
+        _for_each_retained(
+            [&](uint64_t h, uint64_t weight)
+            {
+                if (h > start_h && h <= end_h) estimated_count += static_cast<double>(weight);
+            });
+        return estimated_count;
+    }
+
+    // Keeps the items in (start_h, end_h] on their levels
+    InlineKLL rebuild(uint64_t start_h, uint64_t end_h) const
+    {
+        InlineKLL new_sketch;
+        new_sketch.m_rng_state = m_rng_state ^ 0x9E3779B9u;
+        new_sketch.m_num_levels = m_num_levels;
+
+        // Copy from the top level down so the items stay packed against the end of the buffer
+        uint32_t pos = storage_capacity;
+        for (int32_t level = m_num_levels - 1; level >= 0; --level)
+        {
+            new_sketch.m_levels[level + 1] = pos;
+            for (int32_t i = static_cast<int32_t>(m_levels[level + 1]) - 1; i >= static_cast<int32_t>(m_levels[level]); --i)
+            {
+                uint64_t h = m_items[i];
+                if (h > start_h && h <= end_h)
+                {
+                    new_sketch.m_items[--pos] = h;
+                    new_sketch.m_n += 1ULL << level;
+                }
+            }
+            new_sketch.m_levels[level] = pos;
+        }
+        return new_sketch;
+    }
+
+    template <typename Func> void for_each_summarized_item(Func &&func) const { _for_each_retained(func); }
+
+    static InlineKLL construct_from_weighted_items(const std::vector<std::pair<uint64_t, uint64_t>> &weighted_items, const KLLConfig &config)
+    {
+        InlineKLL sketch(config);
+        for (const auto &[item, weight] : weighted_items) { sketch.update(item, weight); }
+        return sketch;
+    }
+
+    KLLConfig get_config() const { return {K}; }
+
+    // Real footprint: the storage is inline, so this is simply the object size
+    uint32_t get_max_memory_usage() const { return sizeof(InlineKLL); }
+
+    bool is_empty() const { return m_n == 0; }
+    uint64_t get_n() const { return m_n; }
+    uint32_t get_k() const { return K; }
+    uint32_t get_num_retained() const { return storage_capacity - m_levels[0]; }
+    uint8_t get_num_levels() const { return m_num_levels; }
+
+    friend std::ostream &operator<<(std::ostream &os, const InlineKLL &kll)
+    {
+        os << "Inline KLL Sketch:" << std::endl;
+        os << "  k: " << K << std::endl;
+        os << "  count: " << kll.m_n << std::endl;
+        os << "  levels: " << static_cast<int>(kll.m_num_levels) << std::endl;
+        for (uint32_t level = 0; level < kll.m_num_levels; ++level)
+        {
+            os << "  Level " << level << ": size " << kll._level_size(level) << " / capacity " << kll._level_capacity(level) << std::endl;
+        }
+        return os;
+    }
+
+private:
+    static uint32_t _next_seed()
+    {
+        static std::atomic<uint32_t> s_counter{0x2545F491u};
+        uint32_t seed = s_counter.fetch_add(0x9E3779B9u, std::memory_order_relaxed);
+        return seed == 0 ? 1 : seed;
+    }
+
+    // xorshift32: one bit per compaction, no state beyond 4 bytes
+    bool _random_bit()
+    {
+        m_rng_state ^= m_rng_state << 13;
+        m_rng_state ^= m_rng_state >> 17;
+        m_rng_state ^= m_rng_state << 5;
+        return m_rng_state & 1;
+    }
+
+    uint32_t _level_size(uint32_t level) const { return m_levels[level + 1] - m_levels[level]; }
+
+    uint32_t _level_capacity(uint32_t level) const { return level_capacities[m_num_levels - level - 1]; }
+
+    template <typename Func> void _for_each_retained(Func &&func) const
+    {
+        for (uint32_t level = 0; level < m_num_levels; ++level)
+        {
+            uint64_t weight = 1ULL << level;
+            for (uint32_t i = m_levels[level]; i < m_levels[level + 1]; ++i) { func(m_items[i], weight); }
+        }
+    }
+
+    // Inserts one item at the end of a level, shifting the (small) lower levels down by one slot
+    void _insert(uint32_t level, uint64_t item)
+    {
+        if (level >= MaxLevels) { throw std::overflow_error("InlineKLL exceeded its maximum number of levels."); }
+        while (m_num_levels <= level)
+        {
+            ++m_num_levels;
+            m_levels[m_num_levels] = storage_capacity;
+        }
+        if (m_levels[0] == 0) { _make_room(); }
+
+        uint32_t bottom = m_levels[0];
+        uint32_t end = m_levels[level];
+        std::copy(m_items.begin() + bottom, m_items.begin() + end, m_items.begin() + bottom - 1);
+        for (uint32_t l = 0; l <= level; ++l) { --m_levels[l]; }
+        m_items[m_levels[level]] = item;
+    }
+
+    // Frees at least one slot by compacting the lowest level that can shrink
+    void _make_room()
+    {
+        while (m_levels[0] == 0)
+        {
+            int32_t target = -1;
+            for (uint32_t level = 0; level < m_num_levels && target < 0; ++level)
+            {
+                if (_level_size(level) >= std::max<uint32_t>(_level_capacity(level), 2)) target = level;
+            }
+            for (uint32_t level = 0; level < m_num_levels && target < 0; ++level)
+            {
+                if (_level_size(level) >= 2) target = level;
+            }
+            if (target >= 0) { _compress(target); }
+            else { _promote_lowest(); }
+        }
+    }
+
+    // Every level holds at most one item (only reachable with weights near 2^storage_capacity), so no compaction can free a slot.
+    // The lowest item moves up a level with probability 1/2 and is dropped otherwise, which keeps the retained weight unbiased;
+    // once it lands on an occupied level, that level compacts.
+    void _promote_lowest()
+    {
+        uint32_t level = 0;
+        while (_level_size(level) == 0) ++level;
+        uint32_t slot = m_levels[level];
+        if (_random_bit() && level + 1 < MaxLevels)
+        {
+            if (level + 1 == m_num_levels)
+            {
+                ++m_num_levels;
+                m_levels[m_num_levels] = storage_capacity;
+            }
+            m_levels[level + 1] = slot;
+        }
+        else
+        {
+            for (uint32_t l = 0; l <= level; ++l) { m_levels[l] = slot + 1; }
+        }
+    }
+
+    // Halves a level into the one above it: sort, keep every other item of each pair starting at a random offset, move the keepers up.
+    // On an odd level the smallest item has no pair and stays where it is, as in DataSketches.
+    void _compress(uint32_t level)
+    {
+        if (level + 1 >= MaxLevels) { throw std::overflow_error("InlineKLL exceeded its maximum number of levels."); }
+
+        uint32_t start = m_levels[level];
+        uint32_t end = m_levels[level + 1];
+        uint32_t size = end - start;
+        if (size < 2) return;
+
+        std::sort(m_items.begin() + start, m_items.begin() + end);
+        uint32_t offset = _random_bit() ? 1 : 0;
+        uint32_t leftover = size % 2;
+        uint32_t pairs_start = start + leftover;
+
+        // Keepers are packed at the top of the level, adjacent to the level above, with the unpaired item right below them
+        uint32_t keepers = (size - leftover) / 2;
+        uint32_t write = end;
+        for (int32_t i = static_cast<int32_t>(pairs_start + offset + 2 * (keepers - 1)); i >= static_cast<int32_t>(pairs_start); i -= 2) { m_items[--write] = m_items[i]; }
+
+        if (level + 1 == m_num_levels)
+        {
+            ++m_num_levels;
+            m_levels[m_num_levels] = storage_capacity;
+        }
+        m_levels[level + 1] = static_cast<Offset>(write);
+        if (leftover) { m_items[--write] = m_items[start]; }
+
+        // Close the gap left by the discarded items by moving the lower levels up
+        uint32_t gap = write - start;
+        uint32_t bottom = m_levels[0];
+        std::copy_backward(m_items.begin() + bottom, m_items.begin() + start, m_items.begin() + start + gap);
+        for (uint32_t l = 0; l <= level; ++l) { m_levels[l] += gap; }
+    }
+
+    uint64_t m_n;
+    uint8_t m_num_levels;
+    uint32_t m_rng_state;
+    std::array<Offset, MaxLevels + 1> m_levels;   // level l occupies [m_levels[l], m_levels[l + 1]); m_levels[m_num_levels] == storage_capacity
+    std::array<uint64_t, storage_capacity> m_items;
+};
+
+static_assert(std::is_trivially_copyable_v<InlineKLL<10>>, "InlineKLL must stay trivially copyable.");
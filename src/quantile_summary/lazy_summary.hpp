@@ -0,0 +1,105 @@
+#pragma once
+
+#include "quantile_summary_config.hpp"
+
+#include "quantile_summary/bucket_summary.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Bucket summary that is only allocated once it receives data.
+// An empty bucket is just the config and a null pointer, so wide sketches are cheap to construct and buckets that stay empty
+// (e.g. right after expand) cost no summary memory. Every query on an empty bucket answers as an empty summary would.
+template <BucketSummary S> class LazySummary
+{
+public:
+    // Keep compact mode working when the wrapped summary stores fingerprints
+    static constexpr uint32_t hash_bits = summary_hash_bits<S>;
+    static constexpr bool fixed_k = !summary_supports_variable_k<S>;
+
+    explicit LazySummary(const KLLConfig &config) : m_config(config) {}
+
+    LazySummary() : m_config({30}) {}
+
+    LazySummary(const LazySummary &other) : m_config(other.m_config), m_summary(other.m_summary ? std::make_unique<S>(*other.m_summary) : nullptr) {}
+
+    LazySummary &operator=(const LazySummary &other)
+    {
+        if (this == &other) return *this;
+        m_config = other.m_config;
+        m_summary = other.m_summary ? std::make_unique<S>(*other.m_summary) : nullptr;
+        return *this;
+    }
+
+    LazySummary(LazySummary &&other) noexcept = default;
+    LazySummary &operator=(LazySummary &&other) noexcept = default;
+
+    void update(uint64_t item) { _materialize().update(item); }
+
+    void update(uint64_t item, uint64_t weight)
+    {
+        if (weight == 0) return;
+        _materialize().update(item, weight);
+    }
+
+    void merge(const LazySummary &other)
+    {
+        if (!other.m_summary) return;
+        // Merge into a fresh summary rather than copying, exactly as an eagerly constructed bucket would
+        _materialize().merge(*other.m_summary);
+    }
+
+    double estimate(uint64_t item) const { return m_summary ? m_summary->estimate(item) : 0.0; }
+
+    double get_count_in_range(uint64_t start_h, uint64_t end_h) const { return m_summary ? m_summary->get_count_in_range(start_h, end_h) : 0.0; }
+
+    LazySummary rebuild(uint64_t start_h, uint64_t end_h) const
+    {
+        LazySummary new_summary(m_config);
+        if (m_summary) { new_summary.m_summary = std::make_unique<S>(m_summary->rebuild(start_h, end_h)); }
+        return new_summary;
+    }
+
+    template <typename Func> void for_each_summarized_item(Func &&func) const
+    {
+        if (m_summary) { m_summary->for_each_summarized_item(std::forward<Func>(func)); }
+    }
+
+    static LazySummary construct_from_weighted_items(const std::vector<std::pair<uint64_t, uint64_t>> &weighted_items, const KLLConfig &config)
+    {
+        LazySummary result(config);
+        if (!weighted_items.empty()) { result.m_summary = std::make_unique<S>(S::construct_from_weighted_items(weighted_items, config)); }
+        return result;
+    }
+
+    const KLLConfig &get_config() const { return m_config; }
+
+    // Upper bound once materialized, as for the wrapped summary; the budget does not depend on which buckets are populated
+    uint32_t get_max_memory_usage() const { return m_summary ? m_summary->get_max_memory_usage() : S(m_config).get_max_memory_usage(); }
+
+    bool is_materialized() const { return m_summary != nullptr; }
+
+    // Access to the wrapped summary; nullptr while the bucket is empty
+    const S *get_summary() const { return m_summary.get(); }
+
+    friend std::ostream &operator<<(std::ostream &os, const LazySummary &summary)
+    {
+        if (summary.m_summary) { return os << *summary.m_summary; }
+        os << "Lazy summary (not materialized):" << std::endl;
+        os << "  k: " << summary.m_config.k << std::endl;
+        return os;
+    }
+
+private:
+    S &_materialize()
+    {
+        if (!m_summary) { m_summary = std::make_unique<S>(m_config); }
+        return *m_summary;
+    }
+
+    KLLConfig m_config;
+    std::unique_ptr<S> m_summary;
+};
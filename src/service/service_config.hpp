@@ -0,0 +1,24 @@
+#pragma once
+
+#include "utils/ConfigParser.hpp"
+#include "utils/ConfigPrinter.hpp"
+
+#include <string>
+#include <tuple>
+
+struct SketchServiceConfig
+{
+    std::string socket_path;
+    uint32_t port = 0;
+    static void add_params_to_config_parser(SketchServiceConfig &c, ConfigParser &p)
+    {
+        p.AddParameter(new StringParameter("service.socket_path", "/tmp/resketch.sock", &c.socket_path, false, "Unix-domain socket of the sketch service"));
+        p.AddParameter(new UnsignedInt32Parameter("service.port", "0", &c.port, false, "Loopback TCP port to use instead of the Unix socket (0 uses the socket)"));
+    }
+    auto to_tuple() const { return std::make_tuple("socket_path", socket_path, "port", port); }
+    friend std::ostream &operator<<(std::ostream &os, const SketchServiceConfig &c)
+    {
+        ConfigPrinter<SketchServiceConfig>::print(os, c);
+        return os;
+    }
+};
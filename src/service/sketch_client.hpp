@@ -0,0 +1,332 @@
+#pragma once
+
+#include "service/sketch_protocol.hpp"
+
+#include "utils/BinaryStream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Blocking client of SketchServer. The named calls send one request and wait for its response; the send_* calls only queue a request
+// (written out once the send buffer fills or on flush) so that many can be in flight, and receive / sync collect the responses in order.
+// Keep the number of requests in flight bounded: a client that only sends eventually blocks once the server stops reading it.
+class SketchClient
+{
+public:
+    struct Response
+    {
+        uint32_t request_id;
+        sketch_protocol::Status status;
+        std::string body;
+    };
+
+    struct Info
+    {
+        uint32_t width;
+        uint32_t depth;
+        uint64_t total_weight;
+        uint32_t memory_bytes;
+    };
+
+    static SketchClient connect_unix(const std::string &path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) { throw std::invalid_argument("Socket path is empty or too long."); }
+        path.copy(address.sun_path, path.size());
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "socket"); }
+        if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "connect " + path);
+        }
+        return SketchClient(fd);
+    }
+
+    // Connects to a server on the loopback interface
+    static SketchClient connect_tcp(uint16_t port)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "socket"); }
+        if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "connect 127.0.0.1:" + std::to_string(port));
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return SketchClient(fd);
+    }
+
+    SketchClient(const SketchClient &) = delete;
+    SketchClient &operator=(const SketchClient &) = delete;
+    SketchClient(SketchClient &&other) noexcept { *this = std::move(other); }
+    SketchClient &operator=(SketchClient &&other) noexcept
+    {
+        if (this != &other)
+        {
+            _close();
+            m_fd = std::exchange(other.m_fd, -1);
+            m_next_request_id = other.m_next_request_id;
+            m_out = std::move(other.m_out);
+            m_in = std::move(other.m_in);
+            m_in_offset = other.m_in_offset;
+            m_outstanding = std::move(other.m_outstanding);
+        }
+        return *this;
+    }
+    ~SketchClient() { _close(); }
+
+    // An empty source creates a sketch from width, depth and kll_k; otherwise an empty copy of source that can be merged with it
+    void create(std::string_view name, uint32_t width, uint32_t depth, uint32_t kll_k, std::string_view source = {})
+    {
+        size_t start = _begin(sketch_protocol::Opcode::Create, name);
+        binary_stream::append<uint32_t>(m_out, width);
+        binary_stream::append<uint32_t>(m_out, depth);
+        binary_stream::append<uint32_t>(m_out, kll_k);
+        sketch_protocol::append_name(m_out, source);
+        _call(start);
+    }
+
+    void drop(std::string_view name) { _call(_begin(sketch_protocol::Opcode::Drop, name)); }
+
+    void update(std::string_view name, std::span<const uint64_t> items)
+    {
+        send_update(name, items);
+        _wait();
+    }
+
+    void update(std::string_view name, std::span<const std::pair<uint64_t, uint64_t>> weighted_items)
+    {
+        send_update(name, weighted_items);
+        _wait();
+    }
+
+    std::vector<double> estimate(std::string_view name, std::span<const uint64_t> items)
+    {
+        send_estimate(name, items);
+        Response response = _wait();
+        std::string_view body(response.body);
+        std::vector<double> estimates;
+        sketch_protocol::read_array(body, estimates);
+        return estimates;
+    }
+
+    void expand(std::string_view name, uint32_t new_width) { _resize(sketch_protocol::Opcode::Expand, name, new_width); }
+    void shrink(std::string_view name, uint32_t new_width) { _resize(sketch_protocol::Opcode::Shrink, name, new_width); }
+
+    // Merges source into destination; source is kept
+    void merge(std::string_view destination, std::string_view source)
+    {
+        size_t start = _begin(sketch_protocol::Opcode::Merge, destination);
+        sketch_protocol::append_name(m_out, source);
+        _call(start);
+    }
+
+    // name keeps width_kept buckets per row, new_name is created with the other part
+    void split(std::string_view name, std::string_view new_name, uint32_t width_kept, uint32_t width_given)
+    {
+        size_t start = _begin(sketch_protocol::Opcode::Split, name);
+        sketch_protocol::append_name(m_out, new_name);
+        binary_stream::append<uint32_t>(m_out, width_kept);
+        binary_stream::append<uint32_t>(m_out, width_given);
+        _call(start);
+    }
+
+    Info info(std::string_view name)
+    {
+        Response response = _call(_begin(sketch_protocol::Opcode::Info, name));
+        std::string_view body(response.body);
+        Info info;
+        info.width = binary_stream::read<uint32_t>(body);
+        info.depth = binary_stream::read<uint32_t>(body);
+        info.total_weight = binary_stream::read<uint64_t>(body);
+        info.memory_bytes = binary_stream::read<uint32_t>(body);
+        return info;
+    }
+
+    // Pipelined requests; each returns its request id
+    uint32_t send_update(std::string_view name, std::span<const uint64_t> items)
+    {
+        size_t start = _begin(sketch_protocol::Opcode::Update, name);
+        sketch_protocol::append_array(m_out, items);
+        return _end(start);
+    }
+
+    uint32_t send_update(std::string_view name, std::span<const std::pair<uint64_t, uint64_t>> weighted_items)
+    {
+        size_t start = _begin(sketch_protocol::Opcode::UpdateWeighted, name);
+        sketch_protocol::append_array(m_out, weighted_items);
+        return _end(start);
+    }
+
+    uint32_t send_estimate(std::string_view name, std::span<const uint64_t> items)
+    {
+        size_t start = _begin(sketch_protocol::Opcode::Estimate, name);
+        sketch_protocol::append_array(m_out, items);
+        return _end(start);
+    }
+
+    // Writes out the queued requests
+    void flush()
+    {
+        size_t offset = 0;
+        while (offset < m_out.size())
+        {
+            ssize_t n = ::send(m_fd, m_out.data() + offset, m_out.size() - offset, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "send");
+            }
+            offset += static_cast<size_t>(n);
+        }
+        m_out.clear();
+    }
+
+    // The response to the oldest request in flight, flushing first; an Error response is returned, not thrown
+    Response receive()
+    {
+        if (m_outstanding.empty()) { throw std::logic_error("No request is waiting for a response."); }
+        flush();
+        sketch_protocol::Frame frame;
+        while (true)
+        {
+            std::string_view input(m_in);
+            input.remove_prefix(m_in_offset);
+            if (sketch_protocol::next_frame(input, frame))
+            {
+                Response response{frame.request_id, static_cast<sketch_protocol::Status>(frame.code), std::string(frame.body)};
+                m_in_offset = m_in.size() - input.size();
+                if (m_in_offset == m_in.size())
+                {
+                    m_in.clear();
+                    m_in_offset = 0;
+                }
+                if (response.request_id != m_outstanding.front()) { throw std::runtime_error("Response out of order."); }
+                m_outstanding.pop_front();
+                return response;
+            }
+            if (m_in_offset > 0)
+            {
+                m_in.erase(0, m_in_offset);
+                m_in_offset = 0;
+            }
+            _read_more();
+        }
+    }
+
+    // Waits for every request in flight; throws the first error
+    void sync()
+    {
+        std::string error;
+        while (!m_outstanding.empty())
+        {
+            Response response = receive();
+            if (response.status != sketch_protocol::Status::Ok && error.empty()) error = std::move(response.body);
+        }
+        if (!error.empty()) { throw std::runtime_error(error); }
+    }
+
+    size_t get_num_outstanding() const { return m_outstanding.size(); }
+
+private:
+    static constexpr size_t flush_threshold = 1u << 16;
+    static constexpr size_t read_chunk_size = 1u << 16;
+
+    explicit SketchClient(int fd) : m_fd(fd) {}
+
+    void _close()
+    {
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+    }
+
+    size_t _begin(sketch_protocol::Opcode opcode, std::string_view name)
+    {
+        size_t start = sketch_protocol::begin_frame(m_out, m_next_request_id, static_cast<uint8_t>(opcode));
+        sketch_protocol::append_name(m_out, name);
+        return start;
+    }
+
+    uint32_t _end(size_t start)
+    {
+        sketch_protocol::end_frame(m_out, start);
+        m_outstanding.push_back(m_next_request_id);
+        if (m_out.size() >= flush_threshold) flush();
+        return m_next_request_id++;
+    }
+
+    // Sends a request and waits for it (and any request still in flight)
+    Response _call(size_t start)
+    {
+        _end(start);
+        return _wait();
+    }
+
+    // Collects all responses in flight; throws the first error, else returns the last response
+    Response _wait()
+    {
+        Response last{};
+        std::string error;
+        while (!m_outstanding.empty())
+        {
+            last = receive();
+            if (last.status != sketch_protocol::Status::Ok && error.empty()) error = last.body;
+        }
+        if (!error.empty()) { throw std::runtime_error(error); }
+        return last;
+    }
+
+    void _resize(sketch_protocol::Opcode opcode, std::string_view name, uint32_t new_width)
+    {
+        size_t start = _begin(opcode, name);
+        binary_stream::append<uint32_t>(m_out, new_width);
+        _call(start);
+    }
+
+    void _read_more()
+    {
+        size_t size = m_in.size();
+        m_in.resize(size + read_chunk_size);
+        ssize_t n;
+        do
+        {
+            n = ::recv(m_fd, m_in.data() + size, read_chunk_size, 0);
+        } while (n < 0 && errno == EINTR);
+        int error = errno;
+        m_in.resize(size + std::max<ssize_t>(n, 0));
+        if (n < 0) { throw std::system_error(error, std::generic_category(), "recv"); }
+        if (n == 0) { throw std::runtime_error("Sketch server closed the connection."); }
+    }
+
+    int m_fd = -1;
+    uint32_t m_next_request_id = 0;
+    std::string m_out;               // queued requests
+    std::string m_in;                // received bytes
+    size_t m_in_offset = 0;          // start of the first unparsed byte
+    std::deque<uint32_t> m_outstanding;   // ids of the requests in flight, oldest first
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "utils/BinaryStream.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Wire format of the sketch service (SketchServer / SketchClient), host byte order as both ends run on one machine.
+// Request frame:  u32 length | u32 request id | u8 opcode | body      (length counts everything after itself)
+// Response frame: u32 length | u32 request id | u8 status | body      (an Error body is the message)
+// A connection's requests are answered in order, so a client may pipeline any number of them before reading the responses.
+//
+// Bodies (name = u16 length + bytes, array = u32 count + elements):
+//   Create          name, u32 width, u32 depth, u32 kll_k, name source   -> empty; a non-empty source makes an empty copy of it (same seeds
+//                                                                           and rings, so the two can be merged) and ignores width/depth/kll_k
+//   Drop            name                                                 -> empty
+//   Update          name, array of u64 items                             -> empty
+//   UpdateWeighted  name, array of (u64 item, u64 weight)                -> empty
+//   Estimate        name, array of u64 items                             -> array of f64 estimates
+//   Expand, Shrink  name, u32 new width                                  -> empty
+//   Merge           name destination, name source                        -> empty; the source is kept
+//   Split           name, name new, u32 width kept, u32 width given      -> empty; name keeps the lower partition ranges
+//   Info            name                                                 -> u32 width, u32 depth, u64 total weight, u32 memory bytes
+namespace sketch_protocol
+{
+enum class Opcode : uint8_t
+{
+    Create = 1,
+    Drop = 2,
+    Update = 3,
+    UpdateWeighted = 4,
+    Estimate = 5,
+    Expand = 6,
+    Shrink = 7,
+    Merge = 8,
+    Split = 9,
+    Info = 10
+};
+
+enum class Status : uint8_t
+{
+    Ok = 0,
+    Error = 1
+};
+
+constexpr uint32_t max_frame_size = 64u << 20;
+constexpr size_t length_size = sizeof(uint32_t);
+constexpr size_t header_size = length_size + sizeof(uint32_t) + sizeof(uint8_t);
+
+struct Frame
+{
+    uint32_t request_id;
+    uint8_t code;             // Opcode in a request, Status in a response
+    std::string_view body;    // points into the receive buffer
+};
+
+// Starts a frame at the end of buffer; returns its offset for end_frame
+inline size_t begin_frame(std::string &buffer, uint32_t request_id, uint8_t code)
+{
+    size_t start = buffer.size();
+    binary_stream::append<uint32_t>(buffer, 0);
+    binary_stream::append<uint32_t>(buffer, request_id);
+    binary_stream::append<uint8_t>(buffer, code);
+    return start;
+}
+
+inline void end_frame(std::string &buffer, size_t start)
+{
+    auto length = static_cast<uint32_t>(buffer.size() - start - length_size);
+    std::memcpy(buffer.data() + start, &length, sizeof(length));
+}
+
+// The first complete frame at the front of input, which is then consumed; false if more bytes are needed
+inline bool next_frame(std::string_view &input, Frame &frame)
+{
+    if (input.size() < length_size) return false;
+    uint32_t length;
+    std::memcpy(&length, input.data(), sizeof(length));
+    if (length > max_frame_size || length < header_size - length_size) throw std::runtime_error("Malformed frame length.");
+    if (input.size() < length_size + length) return false;
+    std::string_view bytes = input.substr(length_size, length);
+    input.remove_prefix(length_size + length);
+    frame.request_id = binary_stream::read<uint32_t>(bytes);
+    frame.code = binary_stream::read<uint8_t>(bytes);
+    frame.body = bytes;
+    return true;
+}
+
+inline void append_name(std::string &buffer, std::string_view name)
+{
+    if (name.size() > UINT16_MAX) throw std::invalid_argument("Sketch name is too long.");
+    binary_stream::append<uint16_t>(buffer, static_cast<uint16_t>(name.size()));
+    buffer.append(name);
+}
+
+inline std::string_view read_name(std::string_view &input)
+{
+    uint16_t size = binary_stream::read<uint16_t>(input);
+    if (input.size() < size) throw std::runtime_error("Unexpected end of frame.");
+    std::string_view name = input.substr(0, size);
+    input.remove_prefix(size);
+    return name;
+}
+
+template <typename T> void append_array(std::string &buffer, std::span<const T> values)
+{
+    static_assert(binary_stream::is_raw_copyable<T>, "Only trivially copyable values can be sent raw.");
+    binary_stream::append<uint32_t>(buffer, static_cast<uint32_t>(values.size()));
+    buffer.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+// Into a reusable vector, as the frame bytes are not aligned for T
+template <typename T> void read_array(std::string_view &input, std::vector<T> &values)
+{
+    static_assert(binary_stream::is_raw_copyable<T>, "Only trivially copyable values can be received raw.");
+    uint32_t count = binary_stream::read<uint32_t>(input);
+    if (input.size() / sizeof(T) < count) throw std::runtime_error("Unexpected end of frame.");
+    values.resize(count);
+    std::memcpy(static_cast<void *>(values.data()), input.data(), count * sizeof(T));
+    input.remove_prefix(count * sizeof(T));
+}
+}   // namespace sketch_protocol
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "frequency_summary/frequency_summary_config.hpp"
+#include "service/service_config.hpp"
+
+#include "frequency_summary/resketchv2.hpp"
+#include "service/sketch_protocol.hpp"
+
+#include "utils/BinaryStream.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Hosts named sketches behind the binary protocol of sketch_protocol.hpp, on a Unix-domain socket or a loopback TCP port.
+// One thread runs a poll() loop over non-blocking connections: every complete frame in a connection's input is handled in order and its
+// response appended to the connection's output, so pipelined requests are answered in batches. A connection whose unsent responses pile up
+// is not read until they drain, which bounds the memory of a client that sends without reading.
+template <typename Sketch = ReSketchV2> class SketchServer
+{
+    static constexpr size_t read_chunk_size = 1u << 18;
+    static constexpr size_t max_pending_output = 8u << 20;
+
+    struct Connection
+    {
+        explicit Connection(int fd) : fd(fd) {}
+        int fd;
+        std::string in;
+        size_t in_offset = 0;   // start of the first unhandled byte
+        std::string out;
+        size_t out_offset = 0;  // start of the first unsent byte
+        bool closed = false;
+    };
+
+public:
+    // Binds and listens; new sketches take the options of sketch_defaults that a Create request does not carry
+    SketchServer(const SketchServiceConfig &config, const ReSketchConfig &sketch_defaults) : m_config(config), m_sketch_defaults(sketch_defaults)
+    {
+        if (config.port > UINT16_MAX) { throw std::invalid_argument("Port must be below 65536."); }
+        m_listen_fd = config.port != 0 ? _listen_tcp(static_cast<uint16_t>(config.port)) : _listen_unix(config.socket_path);
+    }
+
+    SketchServer(const SketchServer &) = delete;
+    SketchServer &operator=(const SketchServer &) = delete;
+
+    ~SketchServer()
+    {
+        for (auto &connection : m_connections) ::close(connection.fd);
+        ::close(m_listen_fd);
+        if (m_config.port == 0) ::unlink(m_config.socket_path.c_str());
+    }
+
+    // Serves until stop()
+    void run()
+    {
+        std::vector<pollfd> fds;
+        while (!m_stopped.load(std::memory_order_relaxed))
+        {
+            fds.clear();
+            fds.push_back({m_listen_fd, POLLIN, 0});
+            for (const auto &connection : m_connections)
+            {
+                short events = connection.out.size() - connection.out_offset < max_pending_output ? POLLIN : 0;
+                if (connection.out_offset < connection.out.size()) events |= POLLOUT;
+                fds.push_back({connection.fd, events, 0});
+            }
+
+            // The timeout bounds how long a stop() goes unnoticed
+            if (::poll(fds.data(), fds.size(), 100) < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "poll");
+            }
+            // Connections accepted below have no entry in fds yet
+            size_t num_polled = m_connections.size();
+            for (size_t i = 0; i < num_polled; ++i)
+            {
+                Connection &connection = m_connections[i];
+                short revents = fds[i + 1].revents;
+                if (revents & (POLLIN | POLLHUP | POLLERR)) _receive(connection);
+                if (!connection.closed && connection.out_offset < connection.out.size()) _send(connection);
+            }
+            if (fds[0].revents & POLLIN) _accept();
+
+            std::erase_if(m_connections,
+                          [](const Connection &connection)
+                          {
+                              if (connection.closed) ::close(connection.fd);
+                              return connection.closed;
+                          });
+        }
+    }
+
+    // Safe from a signal handler or another thread
+    void stop() { m_stopped.store(true, std::memory_order_relaxed); }
+
+    size_t get_num_sketches() const { return m_sketches.size(); }
+    size_t get_num_connections() const { return m_connections.size(); }
+
+private:
+    static void _set_nonblocking(int fd)
+    {
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) { throw std::system_error(errno, std::generic_category(), "fcntl"); }
+    }
+
+    static int _listen_unix(const std::string &path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) { throw std::invalid_argument("Socket path is empty or too long."); }
+        path.copy(address.sun_path, path.size());
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "socket"); }
+        // A socket file left by a daemon that did not shut down cleanly would fail the bind
+        ::unlink(path.c_str());
+        if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "bind " + path);
+        }
+        _set_nonblocking(fd);
+        return fd;
+    }
+
+    static int _listen_tcp(uint16_t port)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) { throw std::system_error(errno, std::generic_category(), "socket"); }
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "bind 127.0.0.1:" + std::to_string(port));
+        }
+        _set_nonblocking(fd);
+        return fd;
+    }
+
+    void _accept()
+    {
+        while (true)
+        {
+            int fd = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;   // EAGAIN, or out of descriptors until a connection closes
+            }
+            if (m_config.port != 0)
+            {
+                // Responses are complete frames; do not hold them back waiting for more
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            m_connections.emplace_back(fd);
+        }
+    }
+
+    void _receive(Connection &connection)
+    {
+        size_t size = connection.in.size();
+        connection.in.resize(size + read_chunk_size);
+        ssize_t n = ::recv(connection.fd, connection.in.data() + size, read_chunk_size, 0);
+        int error = errno;
+        connection.in.resize(size + std::max<ssize_t>(n, 0));
+        if (n == 0 || (n < 0 && error != EAGAIN && error != EINTR))
+        {
+            connection.closed = true;
+            return;
+        }
+
+        std::string_view input(connection.in);
+        input.remove_prefix(connection.in_offset);
+        sketch_protocol::Frame frame;
+        try
+        {
+            while (sketch_protocol::next_frame(input, frame)) _handle(frame, connection.out);
+        }
+        catch (const std::exception &)
+        {
+            // A malformed length leaves no way to find the next frame
+            connection.closed = true;
+            return;
+        }
+        connection.in_offset = connection.in.size() - input.size();
+        if (connection.in_offset == connection.in.size())
+        {
+            connection.in.clear();
+            connection.in_offset = 0;
+        }
+        else if (connection.in_offset > read_chunk_size)
+        {
+            connection.in.erase(0, connection.in_offset);
+            connection.in_offset = 0;
+        }
+    }
+
+    void _send(Connection &connection)
+    {
+        while (connection.out_offset < connection.out.size())
+        {
+            ssize_t n = ::send(connection.fd, connection.out.data() + connection.out_offset, connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) connection.closed = true;
+                return;
+            }
+            connection.out_offset += static_cast<size_t>(n);
+        }
+        connection.out.clear();
+        connection.out_offset = 0;
+    }
+
+    // Appends the response to out; a failing request is answered with its error message
+    void _handle(const sketch_protocol::Frame &frame, std::string &out)
+    {
+        using sketch_protocol::Status;
+        size_t start = sketch_protocol::begin_frame(out, frame.request_id, static_cast<uint8_t>(Status::Ok));
+        try
+        {
+            _dispatch(static_cast<sketch_protocol::Opcode>(frame.code), frame.body, out);
+        }
+        catch (const std::exception &e)
+        {
+            out.resize(start);
+            start = sketch_protocol::begin_frame(out, frame.request_id, static_cast<uint8_t>(Status::Error));
+            out.append(e.what());
+        }
+        sketch_protocol::end_frame(out, start);
+    }
+
+    void _dispatch(sketch_protocol::Opcode opcode, std::string_view body, std::string &out)
+    {
+        using sketch_protocol::Opcode;
+        switch (opcode)
+        {
+        case Opcode::Create:
+        {
+            std::string name(sketch_protocol::read_name(body));
+            ReSketchConfig config = m_sketch_defaults;
+            config.width = binary_stream::read<uint32_t>(body);
+            config.depth = binary_stream::read<uint32_t>(body);
+            config.kll_k = binary_stream::read<uint32_t>(body);
+            std::string_view source = sketch_protocol::read_name(body);
+            if (m_sketches.contains(name)) { throw std::invalid_argument("Sketch " + name + " already exists."); }
+            if (source.empty()) m_sketches.emplace(std::move(name), Sketch(config));
+            else
+            {
+                Sketch copy = _sketch(source);
+                copy.reset();
+                m_sketches.emplace(std::move(name), std::move(copy));
+            }
+            break;
+        }
+        case Opcode::Drop:
+        {
+            auto it = m_sketches.find(sketch_protocol::read_name(body));
+            if (it == m_sketches.end()) { throw std::invalid_argument("No such sketch."); }
+            m_sketches.erase(it);
+            break;
+        }
+        case Opcode::Update:
+        {
+            Sketch &sketch = _sketch(sketch_protocol::read_name(body));
+            sketch_protocol::read_array(body, m_items);
+            m_weighted_items.resize(m_items.size());
+            for (size_t i = 0; i < m_items.size(); ++i) m_weighted_items[i] = {m_items[i], 1};
+            sketch.update(std::span<const std::pair<uint64_t, uint64_t>>(m_weighted_items));
+            break;
+        }
+        case Opcode::UpdateWeighted:
+        {
+            Sketch &sketch = _sketch(sketch_protocol::read_name(body));
+            sketch_protocol::read_array(body, m_weighted_items);
+            sketch.update(std::span<const std::pair<uint64_t, uint64_t>>(m_weighted_items));
+            break;
+        }
+        case Opcode::Estimate:
+        {
+            const Sketch &sketch = _sketch(sketch_protocol::read_name(body));
+            sketch_protocol::read_array(body, m_items);
+            m_estimates.resize(m_items.size());
+            sketch.estimate_batch(m_items, m_estimates);
+            sketch_protocol::append_array<double>(out, m_estimates);
+            break;
+        }
+        case Opcode::Expand:
+        {
+            Sketch &sketch = _sketch(sketch_protocol::read_name(body));
+            sketch.expand(binary_stream::read<uint32_t>(body));
+            break;
+        }
+        case Opcode::Shrink:
+        {
+            Sketch &sketch = _sketch(sketch_protocol::read_name(body));
+            sketch.shrink(binary_stream::read<uint32_t>(body));
+            break;
+        }
+        case Opcode::Merge:
+        {
+            std::string_view destination_name = sketch_protocol::read_name(body);
+            std::string_view source_name = sketch_protocol::read_name(body);
+            if (destination_name == source_name) { throw std::invalid_argument("Cannot merge a sketch into itself."); }
+            Sketch &destination = _sketch(destination_name);
+            const Sketch &source = _sketch(source_name);
+            // Sketches on the same rings (copies made by Create) merge bucket by bucket without building new rings
+            if (destination.get_width() == source.get_width() && std::ranges::equal(destination.get_rings(), source.get_rings()))
+            {
+                destination.merge_in_place(source);
+            }
+            else
+            {
+                destination = Sketch::merge(destination, source);
+            }
+            break;
+        }
+        case Opcode::Split:
+        {
+            std::string_view name = sketch_protocol::read_name(body);
+            std::string new_name(sketch_protocol::read_name(body));
+            uint32_t width_kept = binary_stream::read<uint32_t>(body);
+            uint32_t width_given = binary_stream::read<uint32_t>(body);
+            if (m_sketches.contains(new_name)) { throw std::invalid_argument("Sketch " + new_name + " already exists."); }
+            Sketch &sketch = _sketch(name);
+            auto [kept, given] = Sketch::split(sketch, width_kept, width_given);
+            sketch = std::move(kept);
+            m_sketches.emplace(std::move(new_name), std::move(given));
+            break;
+        }
+        case Opcode::Info:
+        {
+            const Sketch &sketch = _sketch(sketch_protocol::read_name(body));
+            uint64_t total_weight = 0;
+            for (uint32_t j = 0; j < sketch.get_width(); ++j) total_weight += sketch.get_bucket_count(0, j);
+            binary_stream::append<uint32_t>(out, sketch.get_width());
+            binary_stream::append<uint32_t>(out, sketch.get_depth());
+            binary_stream::append<uint64_t>(out, total_weight);
+            binary_stream::append<uint32_t>(out, sketch.get_max_memory_usage());
+            break;
+        }
+        default:
+            throw std::invalid_argument("Unknown opcode " + std::to_string(static_cast<uint32_t>(opcode)) + ".");
+        }
+    }
+
+    Sketch &_sketch(std::string_view name)
+    {
+        auto it = m_sketches.find(name);
+        if (it == m_sketches.end()) { throw std::invalid_argument("No sketch named " + std::string(name) + "."); }
+        return it->second;
+    }
+
+    SketchServiceConfig m_config;
+    ReSketchConfig m_sketch_defaults;
+    int m_listen_fd = -1;
+    std::atomic<bool> m_stopped{false};
+    std::vector<Connection> m_connections;
+    std::map<std::string, Sketch, std::less<>> m_sketches;
+    // Reused decode buffers
+    std::vector<uint64_t> m_items;
+    std::vector<std::pair<uint64_t, uint64_t>> m_weighted_items;
+    std::vector<double> m_estimates;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Raw I/O (host byte order) of trivially copyable values, as used by the binary sketch formats. Reads throw on a short stream,
+// so a truncated file surfaces as an exception instead of a half-initialized sketch.
+namespace binary_stream
+{
+// std::pair is not trivially copyable (it has a user-provided assignment), but a pair of trivially copyable members is laid out like a struct.
+// Only a pair without padding is copied raw: padding bytes are uninitialized, so they would make the output (and its checksum) nondeterministic.
+template <typename T> constexpr bool is_raw_copyable = std::is_trivially_copyable_v<T>;
+template <typename A, typename B>
+constexpr bool is_raw_copyable<std::pair<A, B>> = std::is_trivially_copyable_v<A> && std::is_trivially_copyable_v<B> && sizeof(std::pair<A, B>) == sizeof(A) + sizeof(B);
+
+// A padded pair of raw-copyable members, written member by member
+template <typename T> constexpr bool is_memberwise_pair = false;
+template <typename A, typename B> constexpr bool is_memberwise_pair<std::pair<A, B>> = is_raw_copyable<A> && is_raw_copyable<B> && !is_raw_copyable<std::pair<A, B>>;
+
+template <typename T> void write(std::ostream &os, const T &value)
+{
+    static_assert(is_raw_copyable<T>, "Only trivially copyable values can be written raw.");
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> T read(std::istream &is)
+{
+    static_assert(is_raw_copyable<T>, "Only trivially copyable values can be read raw.");
+    T value;
+    if (!is.read(reinterpret_cast<char *>(&value), sizeof(T))) { throw std::runtime_error("Unexpected end of binary stream."); }
+    return value;
+}
+
+// Same encoding as write, onto the end of an in-memory buffer
+template <typename T> void append(std::string &buffer, const T &value)
+{
+    static_assert(is_raw_copyable<T>, "Only trivially copyable values can be written raw.");
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> void append_vector(std::string &buffer, const std::vector<T> &values)
+{
+    static_assert(is_raw_copyable<T>, "Only trivially copyable values can be written raw.");
+    append<uint64_t>(buffer, values.size());
+    buffer.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+// Same encoding as read, consuming the front of an in-memory buffer
+template <typename T> T read(std::string_view &input)
+{
+    static_assert(is_raw_copyable<T>, "Only trivially copyable values can be read raw.");
+    if (input.size() < sizeof(T)) throw std::runtime_error("Unexpected end of binary buffer.");
+    T value;
+    std::memcpy(static_cast<void *>(&value), input.data(), sizeof(T));
+    input.remove_prefix(sizeof(T));
+    return value;
+}
+
+// LEB128: 7 bits per byte, low bits first; small values (e.g. deltas of sorted hashes) take few bytes
+inline void append_varint(std::string &buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+}
+
+// Consumes one varint from the front of input
+inline uint64_t read_varint(std::string_view &input)
+{
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7)
+    {
+        if (input.empty()) throw std::runtime_error("Unexpected end of varint.");
+        auto byte = static_cast<uint8_t>(input.front());
+        input.remove_prefix(1);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    throw std::runtime_error("Varint is longer than 64 bits.");
+}
+
+// Element count (uint64_t) followed by the elements
+template <typename T> void write_vector(std::ostream &os, const std::vector<T> &values)
+{
+    static_assert(is_raw_copyable<T> || is_memberwise_pair<T>, "Only trivially copyable values can be written raw.");
+    write<uint64_t>(os, values.size());
+    if constexpr (is_memberwise_pair<T>)
+    {
+        for (const auto &[first, second] : values)
+        {
+            write(os, first);
+            write(os, second);
+        }
+    }
+    else
+    {
+        os.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    }
+}
+
+template <typename T> std::vector<T> read_vector(std::istream &is)
+{
+    static_assert(is_raw_copyable<T> || is_memberwise_pair<T>, "Only trivially copyable values can be read raw.");
+    uint64_t size = read<uint64_t>(is);
+    std::vector<T> values;
+    if constexpr (is_memberwise_pair<T>)
+    {
+        // One element at a time, so a corrupt size fails at the end of the stream instead of allocating up front
+        while (values.size() < size)
+        {
+            auto first = read<typename T::first_type>(is);
+            values.emplace_back(first, read<typename T::second_type>(is));
+        }
+        return values;
+    }
+    // Grow as the data arrives, so a corrupt size cannot request an absurd allocation up front
+    constexpr uint64_t chunk = (1u << 16) / sizeof(T) + 1;
+    while (values.size() < size)
+    {
+        size_t offset = values.size();
+        values.resize(offset + std::min<uint64_t>(chunk, size - offset));
+        auto bytes = static_cast<std::streamsize>((values.size() - offset) * sizeof(T));
+        if (!is.read(reinterpret_cast<char *>(values.data() + offset), bytes)) { throw std::runtime_error("Unexpected end of binary stream."); }
+    }
+    return values;
+}
+}   // namespace binary_stream
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+
+namespace sorting_network_detail
+{
+// Visits the comparators of Batcher's odd-even merge sort for n elements; works for any n, not only powers of two
+template <typename Visit> constexpr void for_each_comparator(std::size_t n, Visit &&visit)
+{
+    for (std::size_t p = 1; p < n; p *= 2)
+    {
+        for (std::size_t k = p; k >= 1; k /= 2)
+        {
+            for (std::size_t j = k % p; j + k < n; j += 2 * k)
+            {
+                for (std::size_t i = 0; i < k && i + j + k < n; ++i)
+                {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) { visit(i + j, i + j + k); }
+                }
+            }
+        }
+    }
+}
+
+constexpr std::size_t num_comparators(std::size_t n)
+{
+    std::size_t count = 0;
+    for_each_comparator(n, [&](std::size_t, std::size_t) { ++count; });
+    return count;
+}
+
+template <std::size_t N> constexpr auto build_network()
+{
+    std::array<std::pair<std::size_t, std::size_t>, num_comparators(N)> network{};
+    std::size_t count = 0;
+    for_each_comparator(N, [&](std::size_t i, std::size_t j) { network[count++] = {i, j}; });
+    return network;
+}
+}   // namespace sorting_network_detail
+
+// Batcher's odd-even merge sort network for N elements, generated at compile time.
+// Applying the network is a fixed sequence of branch-free compare-exchanges, fully unrolled by the fold in sort().
+template <std::size_t N> class SortingNetwork
+{
+public:
+    static constexpr auto comparators = sorting_network_detail::build_network<N>();
+
+    template <typename T> static constexpr void sort(std::array<T, N> &values)
+    {
+        [&]<std::size_t... C>(std::index_sequence<C...>)
+        {
+            (_compare_exchange(values, comparators[C].first, comparators[C].second), ...);
+        }(std::make_index_sequence<comparators.size()>{});
+    }
+
+    // Median of N values; for even N it is the mean of the two middle values
+    template <typename T> static constexpr T median(std::array<T, N> values)
+    {
+        static_assert(N > 0, "Median of an empty set is undefined.");
+        sort(values);
+        if constexpr (N % 2 == 0) { return (values[N / 2 - 1] + values[N / 2]) / 2; }
+        else
+        {
+            return values[N / 2];
+        }
+    }
+
+private:
+    template <typename T> static constexpr void _compare_exchange(std::array<T, N> &values, std::size_t i, std::size_t j)
+    {
+        const T a = values[i];
+        const T b = values[j];
+        values[i] = std::min(a, b);
+        values[j] = std::max(a, b);
+    }
+};
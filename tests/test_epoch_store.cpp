@@ -0,0 +1,94 @@
+#include "frequency_summary/epoch_store.hpp"
+
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static std::vector<uint64_t> bucket_counts(const ReSketchV2 &sketch)
+{
+    std::vector<uint64_t> counts;
+    for (uint32_t i = 0; i < sketch.get_depth(); ++i)
+    {
+        for (uint32_t j = 0; j < sketch.get_width(); ++j) counts.push_back(sketch.get_bucket_count(i, j));
+    }
+    return counts;
+}
+
+static uint64_t total_count(const ReSketchV2 &sketch)
+{
+    uint64_t total = 0;
+    for (uint32_t j = 0; j < sketch.get_width(); ++j) total += sketch.get_bucket_count(0, j);
+    return total;
+}
+
+// Epochs survive a reopen bucket for bucket, a ring change starts a new base, and a torn last record is dropped
+int main()
+{
+    std::filesystem::path directory = make_test_directory("epoch_store");
+    std::string path = (directory / "epochs.rse").string();
+    constexpr uint64_t last_timestamp = std::numeric_limits<uint64_t>::max();
+    const std::vector<uint64_t> timestamps = {0, 3600, 7200, last_timestamp};
+
+    ReSketchConfig config{64, 3, 10};
+    config.hll_precision = 8;
+    ReSketchV2 sketch(config);
+    std::vector<std::vector<uint64_t>> expected_counts;
+    {
+        ReSketchEpochStore<> store(path);
+        for (size_t e = 0; e < timestamps.size(); ++e)
+        {
+            sketch.reset();
+            if (e == 2) sketch.expand(96);
+            for (uint64_t i = 0; i < 5000; ++i) sketch.update(i % 200 + e);
+            expected_counts.push_back(bucket_counts(sketch));
+            store.append(timestamps[e], sketch);
+        }
+        CHECK(store.get_num_bases() == 2);
+        bool rejected = false;
+        try
+        {
+            store.append(7200, sketch);
+        }
+        catch (const std::invalid_argument &)
+        {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+
+    {
+        ReSketchEpochStore<> store(path);
+        CHECK(store.get_timestamps() == timestamps);
+        CHECK(store.get_num_bases() == 2);
+        for (size_t e = 0; e < timestamps.size(); ++e) CHECK(bucket_counts(store.load(timestamps[e])) == expected_counts[e]);
+        // Epochs on the old rings are remapped onto those of the first epoch in the range
+        ReSketchV2 all = store.load_range(0, last_timestamp);
+        CHECK(all.get_width() == 64);
+        CHECK(total_count(all) == 3 * 5000);
+        CHECK(total_count(store.load_range(3600, last_timestamp)) == 2 * 5000);
+    }
+
+    // A crash in the middle of an append leaves the last record short
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+    {
+        ReSketchEpochStore<> store(path);
+        CHECK(store.get_num_epochs() == timestamps.size() - 1);
+        CHECK(bucket_counts(store.load(7200)) == expected_counts[2]);
+        sketch.reset();
+        sketch.update(1);
+        store.append(last_timestamp, sketch);
+    }
+    {
+        ReSketchEpochStore<> store(path);
+        CHECK(store.get_num_epochs() == timestamps.size());
+        CHECK(store.load(last_timestamp).estimate(1) == 1.0);
+    }
+
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "frequency_summary/resketch_pool.hpp"
+
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+using Pool = ReSketchPool<64>;
+
+static std::vector<uint64_t> bucket_counts(const Pool::Sketch &sketch)
+{
+    std::vector<uint64_t> counts;
+    for (uint32_t i = 0; i < sketch.get_depth(); ++i)
+    {
+        for (uint32_t j = 0; j < sketch.get_width(); ++j) counts.push_back(sketch.get_bucket_count(i, j));
+    }
+    return counts;
+}
+
+// Tenants match standalone sketches across spills to disk and reloads, and equal topologies stay shared however a tenant got them
+int main()
+{
+    constexpr uint64_t num_tenants = 12;
+    constexpr uint64_t num_items = 50;
+    std::filesystem::path directory = make_test_directory("resketch_pool");
+    ReSketchConfig sketch_config{64, 3, 64};
+    ReSketchPoolConfig config;
+    config.spill_directory = (directory / "spill").string();
+    config.max_resident_tenants = 3;
+
+    {
+        Pool pool(sketch_config, config);
+        std::vector<Pool::Sketch> references;
+        for (uint64_t t = 0; t < num_tenants; ++t)
+        {
+            pool.create(t);
+            references.push_back(pool.get(t));
+        }
+        for (uint64_t round = 0; round < 20; ++round)
+        {
+            for (uint64_t t = 0; t < num_tenants; ++t)
+            {
+                for (uint64_t i = 0; i < num_items; ++i)
+                {
+                    pool.update(t, i * num_tenants + t, round + 1);
+                    references[t].update(i * num_tenants + t, round + 1);
+                }
+            }
+        }
+        CHECK(pool.get_num_resident_tenants() == config.max_resident_tenants);
+        CHECK(pool.get_num_topologies() == 1);
+
+        for (uint64_t t = 0; t < num_tenants; ++t) CHECK(bucket_counts(pool.get(t)) == bucket_counts(references[t]));
+
+        // Estimates do not change when a tenant is spilled and reloaded
+        std::vector<double> before;
+        for (uint64_t i = 0; i < num_items; ++i) before.push_back(pool.estimate(0, i * num_tenants));
+        for (uint64_t t = 1; t < num_tenants; ++t) pool.estimate(t, 0);
+        for (uint64_t i = 0; i < num_items; ++i) CHECK(pool.estimate(0, i * num_tenants) == before[i]);
+
+        // A sketch put back, or reloaded from a spill file, finds the topology it came from
+        pool.put(0, pool.get(0));
+        CHECK(pool.get_num_topologies() == 1);
+        pool.expand(1, 96);
+        CHECK(pool.get_num_topologies() == 2);
+        pool.put(num_tenants, pool.get(1));
+        for (uint64_t t = 2; t < num_tenants; ++t) pool.estimate(t, 0);
+        pool.put(num_tenants + 1, pool.get(num_tenants));
+        CHECK(pool.get_num_topologies() == 2);
+
+        pool.merge(2, 3);
+        references[2].merge_in_place(references[3]);
+        CHECK(bucket_counts(pool.get(2)) == bucket_counts(references[2]));
+
+        pool.drop(1);
+        pool.drop(num_tenants);
+        pool.drop(num_tenants + 1);
+        CHECK(pool.get_num_topologies() == 1);
+    }
+    // Spill files belong to the pool
+    CHECK(std::filesystem::is_empty(directory / "spill"));
+
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "frequency_summary/shared_memory_resketch.hpp"
+
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+static uint64_t total_count(const SharedMemoryReSketch<64> &sketch)
+{
+    uint64_t total = 0;
+    for (uint32_t j = 0; j < sketch.get_width(); ++j) total += sketch.get_bucket_count(0, j);
+    return total;
+}
+
+// A reader in another mapping sees the writer's updates, and the writer role passes on when its holder dies without releasing it
+int main()
+{
+    std::string name = "/resketch_test_" + std::to_string(getpid());
+    SharedMemoryReSketch<64>::unlink(name);
+    ReSketchConfig config{128, 3, 64};
+    config.top_k_candidates = 0;
+    config.hll_precision = 0;
+
+    auto writer = SharedMemoryReSketch<64>::create(name, config);
+    CHECK(writer.is_writer());
+    CHECK(writer.get_max_memory_usage() >= sizeof(uint64_t) * config.width * config.depth);
+    for (uint64_t i = 0; i < 10000; ++i) writer.update(i % 100);
+    writer.update(7, 5000);
+
+    auto reader = SharedMemoryReSketch<64>::open(name);
+    CHECK(!reader.is_writer());
+    CHECK(total_count(reader) == 15000);
+    CHECK(reader.estimate(7) == writer.estimate(7));
+    // 5100 occurrences; the bucket summaries are approximate, the bucket totals above are exact
+    CHECK(reader.estimate(7) > 4500);
+
+    // A second writer is refused while the holder lives
+    auto contender = SharedMemoryReSketch<64>::open(name, true);
+    CHECK(!contender.try_acquire_writer());
+
+    // The child takes the role, updates and exits holding it, as a crashed writer would
+    writer.release_writer();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        auto child_writer = SharedMemoryReSketch<64>::open(name, true);
+        if (!child_writer.try_acquire_writer()) _exit(2);
+        for (uint64_t i = 0; i < 1000; ++i) child_writer.update(9);
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    CHECK(contender.try_acquire_writer());
+    CHECK(total_count(reader) == 16000);
+    contender.update(9);
+    CHECK(reader.estimate(9) == contender.estimate(9));
+    CHECK(reader.estimate(9) > 900);
+
+    SharedMemoryReSketch<64>::unlink(name);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "service/sketch_client.hpp"
+#include "service/sketch_server.hpp"
+
+#include "test_utils.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <typename Func> static bool throws(Func &&func)
+{
+    try
+    {
+        func();
+    }
+    catch (const std::runtime_error &)
+    {
+        return true;
+    }
+    return false;
+}
+
+// Requests round-trip through the daemon; a rejected request is answered with an error and leaves the connection usable
+int main()
+{
+    std::filesystem::path directory = make_test_directory("sketch_service");
+    SketchServiceConfig service_config;
+    service_config.socket_path = (directory / "service.sock").string();
+    ReSketchConfig defaults{64, 3, 10};
+
+    SketchServer<> server(service_config, defaults);
+    std::thread server_thread([&]() { server.run(); });
+
+    {
+        SketchClient client = SketchClient::connect_unix(service_config.socket_path);
+        client.create("a", 64, 3, 10);
+        client.create("b", 0, 0, 0, "a");
+
+        std::vector<uint64_t> items(1000, 7);
+        client.update("a", items);
+        std::vector<std::pair<uint64_t, uint64_t>> weighted_items = {{7, 40}, {7, 2}};
+        client.update("b", weighted_items);
+        CHECK(client.estimate("a", items).front() == 1000.0);
+        CHECK(client.info("b").total_weight == 42);
+
+        // Rejected requests, each answered with an error
+        CHECK(throws([&]() { client.create("zero", 0, 3, 10); }));
+        CHECK(throws([&]() { client.create("a", 64, 3, 10); }));
+        CHECK(throws([&]() { client.merge("a", "a"); }));
+        CHECK(throws([&]() { client.info("missing"); }));
+
+        // Pipelined updates from a second connection, answered in order
+        SketchClient second = SketchClient::connect_unix(service_config.socket_path);
+        for (int i = 0; i < 32; ++i) second.send_update("a", items);
+        second.sync();
+        CHECK(client.info("a").total_weight == 33 * 1000);
+
+        client.merge("b", "a");
+        CHECK(client.info("b").total_weight == 33 * 1000 + 42);
+        CHECK(client.estimate("b", std::vector<uint64_t>{7}).front() == 33 * 1000 + 42.0);
+
+        client.split("b", "c", 40, 24);
+        SketchClient::Info kept = client.info("b"), given = client.info("c");
+        CHECK(kept.width == 40 && given.width == 24);
+        CHECK(kept.total_weight + given.total_weight == 33 * 1000 + 42);
+        client.drop("c");
+        CHECK(throws([&]() { client.info("c"); }));
+    }
+
+    server.stop();
+    server_thread.join();
+    std::filesystem::remove_all(directory);
+    return 0;
+}
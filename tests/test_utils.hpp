@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+// Minimal checks for the ctest executables: a failed check reports where it failed and ends the test with a non-zero status
+#define CHECK(condition)                                                                                                                                                   \
+    do                                                                                                                                                                     \
+    {                                                                                                                                                                      \
+        if (!(condition))                                                                                                                                                  \
+        {                                                                                                                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl;                                                                     \
+            std::exit(1);                                                                                                                                                  \
+        }                                                                                                                                                                  \
+    } while (false)
+
+// Fresh, empty directory for one test run; the pid keeps concurrent ctest runs apart
+inline std::filesystem::path make_test_directory(const std::string &name)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / ("resketch_" + name + "_" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    return directory;
+}